@@ -0,0 +1,101 @@
+#include <string.h>
+#include <windows.h>
+
+#include "bufpool-win.h"
+
+// Large pages are only granted once the privilege is enabled in the token
+static int enable_lock_memory(void) {
+    static volatile LONG state;  // 0 untried, 1 enabled, 2 refused
+    if (state != 0) {
+        return state == 1;
+    }
+
+    HANDLE hToken;
+    TOKEN_PRIVILEGES privileges;
+    int ok = 0;
+    if (OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken)) {
+        privileges.PrivilegeCount = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        // Succeeds without granting anything when the account lacks the
+        // right, which only shows in the last error
+        ok = LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+             AdjustTokenPrivileges(hToken, FALSE, &privileges, 0, NULL, NULL) &&
+             GetLastError() == ERROR_SUCCESS;
+        CloseHandle(hToken);
+    }
+    InterlockedExchange(&state, ok ? 1 : 2);
+    return ok;
+}
+
+static size_t round_up(size_t size, size_t unit) {
+    return (size + unit - 1) / unit * unit;
+}
+
+size_t bufpool_page_size(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+
+int bufpool_create(BufPool *pool, size_t buffer_size, int count, size_t max_region) {
+    memset(pool, 0, sizeof(*pool));
+    InitializeSListHead(&pool->free_list);
+    if (buffer_size == 0 || count < 1) {
+        return 0;
+    }
+    pool->buffer_size = buffer_size;
+    pool->stride = round_up(buffer_size, bufpool_page_size());
+    pool->count = count;
+    pool->region_size = pool->stride * (size_t)count;
+    if (pool->region_size > max_region) {
+        pool->region_size = 0;
+        return 0;
+    }
+
+    // Large pages spare the TLB on multi-MB buffers; worth it only when
+    // the region spans at least one, and only if the rounding to whole
+    // large pages still fits
+    size_t large_page = GetLargePageMinimum();
+    if (large_page > 0 && pool->region_size >= large_page &&
+        round_up(pool->region_size, large_page) <= max_region && enable_lock_memory()) {
+        size_t large_size = round_up(pool->region_size, large_page);
+        pool->base = (unsigned char *)VirtualAlloc(
+            NULL, large_size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (pool->base) {
+            pool->region_size = large_size;
+            pool->large_pages = 1;
+        }
+    }
+    if (!pool->base) {
+        pool->base = (unsigned char *)VirtualAlloc(
+            NULL, pool->region_size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    }
+    if (!pool->base) {
+        pool->region_size = 0;
+        return 0;
+    }
+
+    // Pushed in reverse, so buffers come out in address order
+    for (int i = count - 1; i >= 0; i--) {
+        InterlockedPushEntrySList(&pool->free_list,
+                                  (PSLIST_ENTRY)(pool->base + (size_t)i * pool->stride));
+    }
+    return 1;
+}
+
+unsigned char *bufpool_acquire(BufPool *pool) {
+    return (unsigned char *)InterlockedPopEntrySList(&pool->free_list);
+}
+
+void bufpool_release(BufPool *pool, unsigned char *buffer) {
+    if (buffer) {
+        InterlockedPushEntrySList(&pool->free_list, (PSLIST_ENTRY)buffer);
+    }
+}
+
+void bufpool_destroy(BufPool *pool) {
+    if (pool->base) {
+        VirtualFree(pool->base, 0, MEM_RELEASE);
+    }
+    memset(pool, 0, sizeof(*pool));
+}
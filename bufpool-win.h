@@ -0,0 +1,40 @@
+#ifndef BUFPOOL_WIN_H
+#define BUFPOOL_WIN_H
+
+#include <stddef.h>
+#include <windows.h>
+
+// Fixed-size I/O buffers carved out of one region, allocated once per
+// pass. Every buffer is page aligned, as FILE_FLAG_NO_BUFFERING requires.
+// Acquire and release are lock-free, so any number of threads can share a
+// pool without allocating per request.
+typedef struct {
+    SLIST_HEADER free_list;   // Free buffers, linked through their first bytes
+    unsigned char *base;
+    size_t region_size;
+    size_t buffer_size;       // Usable bytes per buffer
+    size_t stride;            // buffer_size rounded up to whole pages
+    int count;
+    int large_pages;          // Region is backed by large pages
+} BufPool;
+
+// Size of a normal page; every buffer takes up a whole number of them
+size_t bufpool_page_size(void);
+
+// Reserve count buffers of buffer_size bytes in a region of at most
+// max_region bytes. Tries large pages first, which needs the "Lock pages in
+// memory" right and rounds the region up to whole large pages, and falls
+// back to normal pages. Returns 0 if the memory could not be had or would
+// not fit in max_region.
+int bufpool_create(BufPool *pool, size_t buffer_size, int count, size_t max_region);
+
+// Take a free buffer, or NULL when all are in use
+unsigned char *bufpool_acquire(BufPool *pool);
+
+// Give back a buffer taken from this pool
+void bufpool_release(BufPool *pool, unsigned char *buffer);
+
+// Free the region; buffers still acquired become invalid
+void bufpool_destroy(BufPool *pool);
+
+#endif /* BUFPOOL_WIN_H */
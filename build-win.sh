@@ -17,11 +17,25 @@ fi
 
 cd "$SCRIPTDIR"
 
-# Compile Windows versions
+CC="x86_64-w64-mingw32-gcc -std=c99 -Wall -Wextra"
+LIB_SOURCES="libf3-win.c iotune-win.c bufpool-win.c extmap.c pattern.c result.c rawlayout.c quickplan.c progress-win.c f3write-win.c f3read-win.c f3probe-win.c f3certify-win.c f3endurance-win.c"
+
+# Build the engine library shared by all front ends
+echo "Compiling libf3.a..."
+OBJECTS=""
+for src in $LIB_SOURCES; do
+  $CC -c "$src" -o "${src%.c}.o"
+  OBJECTS="$OBJECTS ${src%.c}.o"
+done
+rm -f libf3.a
+x86_64-w64-mingw32-ar rcs libf3.a $OBJECTS
+
+# Link the f3 multi-command binary and the standalone tools
 echo "Compiling Windows versions..."
-x86_64-w64-mingw32-gcc -std=c99 -Wall -Wextra f3write-win.c -o f3write.exe
-x86_64-w64-mingw32-gcc -std=c99 -Wall -Wextra f3read-win.c -o f3read.exe
-x86_64-w64-mingw32-gcc -std=c99 -Wall -Wextra f3probe-win.c -o f3probe.exe
+$CC f3-win.c libf3.a -o f3.exe
+$CC -DF3_COMMAND=f3_write_main f3-win.c libf3.a -o f3write.exe
+$CC -DF3_COMMAND=f3_read_main f3-win.c libf3.a -o f3read.exe
+$CC -DF3_COMMAND=f3_probe_main f3-win.c libf3.a -o f3probe.exe
 
 echo "Build completed successfully!"
 echo "Windows executables are in: $SCRIPTDIR"
\ No newline at end of file
@@ -27,7 +27,7 @@ mkdir -p "$RELEASE_DIR"
 
 # Copy files to release directory
 echo "Copying files to release directory..."
-cp f3write.exe f3read.exe f3probe.exe "$RELEASE_DIR/"
+cp f3.exe f3write.exe f3read.exe f3probe.exe "$RELEASE_DIR/"
 cp f3-test.bat f3probe-test.bat "$RELEASE_DIR/"
 cp README.md README_WINDOWS.txt "$RELEASE_DIR/"
 
@@ -0,0 +1,281 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "extmap.h"
+
+static const char *state_names[EXT_NUM_STATES] = {
+    "good", "changed", "overwritten", "zero", "unreadable", "write-failed"
+};
+
+void extmap_init(ExtMap *map, int max_runs) {
+    memset(map, 0, sizeof(*map));
+    map->max_runs = max_runs > 4 ? max_runs : EXTMAP_DEFAULT_MAX_RUNS;
+}
+
+void extmap_free(ExtMap *map) {
+    free(map->runs);
+    map->runs = NULL;
+    map->count = 0;
+    map->capacity = 0;
+}
+
+const char *extmap_state_name(ExtState state) {
+    return state < EXT_NUM_STATES ? state_names[state] : "unknown";
+}
+
+// Make room for extra more runs
+static int reserve(ExtMap *map, int extra) {
+    if (map->count + extra <= map->capacity) {
+        return 1;
+    }
+
+    int capacity = map->capacity ? map->capacity : 64;
+    while (capacity < map->count + extra) {
+        capacity *= 2;
+    }
+
+    Extent *runs = (Extent *)realloc(map->runs, capacity * sizeof(Extent));
+    if (!runs) {
+        return 0;
+    }
+    map->runs = runs;
+    map->capacity = capacity;
+    return 1;
+}
+
+// Merge adjacent runs that touch and share a state
+static void compact(ExtMap *map) {
+    int out = 0;
+    for (int i = 0; i < map->count; i++) {
+        if (out > 0 &&
+            map->runs[out - 1].end == map->runs[i].start &&
+            map->runs[out - 1].state == map->runs[i].state) {
+            map->runs[out - 1].end = map->runs[i].end;
+        } else {
+            map->runs[out++] = map->runs[i];
+        }
+    }
+    map->count = out;
+}
+
+// Absorb ever longer short runs and gaps lying between two bad runs
+// until the map is back to half its limit
+static void coarsen(ExtMap *map) {
+    uint64_t span = map->runs[map->count - 1].end - map->runs[0].start;
+
+    for (uint64_t min_len = 4096; map->count > map->max_runs / 2; min_len *= 2) {
+        int before = map->count;
+        for (int i = 1; i + 1 < map->count; i++) {
+            Extent *prev = &map->runs[i - 1];
+            Extent *cur = &map->runs[i];
+            Extent *next = &map->runs[i + 1];
+
+            if (prev->state == EXT_GOOD || next->state == EXT_GOOD) {
+                continue;
+            }
+            if (cur->end - prev->end < min_len && next->start - cur->end < min_len) {
+                // Bad on both sides: the run and the gaps around it go bad too
+                prev->end = cur->start;
+                cur->state = prev->state;
+                cur->end = next->start;
+            }
+        }
+        compact(map);
+
+        // Once min_len covers the whole map, passes only help while they still merge
+        if (min_len > span && map->count == before) {
+            break;
+        }
+    }
+
+    // Runs separated by untested gaps between good runs cannot be merged;
+    // let the map grow rather than coarsening again on every append
+    if (map->count > map->max_runs / 2) {
+        map->max_runs *= 2;
+    }
+    map->coarsened = 1;
+}
+
+int extmap_set(ExtMap *map, uint64_t start, uint64_t end, ExtState state) {
+    if (start >= end) {
+        return 1;
+    }
+
+    // Fast path: ranges arriving in ascending order
+    if (map->count == 0 || start >= map->runs[map->count - 1].end) {
+        Extent *last = map->count ? &map->runs[map->count - 1] : NULL;
+        if (last && last->end == start && last->state == state) {
+            last->end = end;
+            return 1;
+        }
+        if (!reserve(map, 1)) {
+            return 0;
+        }
+        map->runs[map->count].start = start;
+        map->runs[map->count].end = end;
+        map->runs[map->count].state = state;
+        map->count++;
+        if (map->count > map->max_runs) {
+            coarsen(map);
+        }
+        return 1;
+    }
+
+    // Runs [lo, hi) overlap [start, end)
+    int lo = 0, hi = map->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (map->runs[mid].end > start) hi = mid; else lo = mid + 1;
+    }
+    hi = lo;
+    while (hi < map->count && map->runs[hi].start < end) {
+        hi++;
+    }
+
+    // Pieces of the first and last overlapped runs that stick out survive
+    Extent left = {0, 0, EXT_GOOD}, right = {0, 0, EXT_GOOD};
+    int has_left = 0, has_right = 0;
+    if (lo < hi && map->runs[lo].start < start) {
+        left = map->runs[lo];
+        left.end = start;
+        has_left = 1;
+    }
+    if (lo < hi && map->runs[hi - 1].end > end) {
+        right = map->runs[hi - 1];
+        right.start = end;
+        has_right = 1;
+    }
+
+    int added = has_left + 1 + has_right;
+    int removed = hi - lo;
+    if (added > removed && !reserve(map, added - removed)) {
+        return 0;
+    }
+    memmove(&map->runs[lo + added], &map->runs[hi], (map->count - hi) * sizeof(Extent));
+    map->count += added - removed;
+
+    int i = lo;
+    if (has_left) {
+        map->runs[i++] = left;
+    }
+    map->runs[i].start = start;
+    map->runs[i].end = end;
+    map->runs[i].state = state;
+    i++;
+    if (has_right) {
+        map->runs[i] = right;
+    }
+
+    compact(map);
+    if (map->count > map->max_runs) {
+        coarsen(map);
+    }
+    return 1;
+}
+
+uint64_t extmap_bytes(const ExtMap *map, ExtState state) {
+    uint64_t total = 0;
+    for (int i = 0; i < map->count; i++) {
+        if (map->runs[i].state == state) {
+            total += map->runs[i].end - map->runs[i].start;
+        }
+    }
+    return total;
+}
+
+uint64_t extmap_first_bad(const ExtMap *map) {
+    for (int i = 0; i < map->count; i++) {
+        if (map->runs[i].state != EXT_GOOD) {
+            return map->runs[i].start;
+        }
+    }
+    return UINT64_MAX;
+}
+
+uint64_t extmap_safe_size(const ExtMap *map, uint64_t limit, uint64_t align) {
+    uint64_t safe = limit;
+
+    for (int i = 0; i < map->count; i++) {
+        if (map->runs[i].state != EXT_GOOD) {
+            // Stop at the last good byte actually seen before the failure
+            if (i > 0 && map->runs[i - 1].end == map->runs[i].start) {
+                safe = map->runs[i].start;
+            } else {
+                safe = i > 0 ? map->runs[i - 1].end : 0;
+            }
+            break;
+        }
+    }
+
+    if (safe > limit) {
+        safe = limit;
+    }
+    if (align > 1) {
+        safe -= safe % align;
+    }
+    return safe;
+}
+
+void extmap_print(const ExtMap *map, FILE *out, int bad_only) {
+    for (int i = 0; i < map->count; i++) {
+        const Extent *r = &map->runs[i];
+        if (bad_only && r->state == EXT_GOOD) {
+            continue;
+        }
+        fprintf(out, "  %14" PRIu64 " - %14" PRIu64 "  %10.2f MB  %s\n",
+                r->start, r->end, (double)(r->end - r->start) / (1024 * 1024),
+                extmap_state_name(r->state));
+    }
+    if (map->coarsened) {
+        fprintf(out, "  (short good runs between bad ones were merged to keep the map small)\n");
+    }
+}
+
+int extmap_save(const ExtMap *map, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (!f) {
+        return 0;
+    }
+
+    fprintf(f, "f3-extmap 1 %d\n", map->coarsened);
+    for (int i = 0; i < map->count; i++) {
+        fprintf(f, "%" PRIu64 " %" PRIu64 " %s\n", map->runs[i].start, map->runs[i].end,
+                extmap_state_name(map->runs[i].state));
+    }
+
+    int ok = !ferror(f);
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+    return ok;
+}
+
+int extmap_load(ExtMap *map, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+        return 0;
+    }
+
+    int version = 0, coarsened = 0;
+    if (fscanf(f, "f3-extmap %d %d", &version, &coarsened) != 2 || version != 1) {
+        fclose(f);
+        return 0;
+    }
+
+    uint64_t start, end;
+    char name[32];
+    int ok = 1;
+    while (ok && fscanf(f, "%" SCNu64 " %" SCNu64 " %31s", &start, &end, name) == 3) {
+        int state = 0;
+        while (state < EXT_NUM_STATES && strcmp(state_names[state], name) != 0) {
+            state++;
+        }
+        ok = state < EXT_NUM_STATES && extmap_set(map, start, end, (ExtState)state);
+    }
+    ok = ok && feof(f);
+    map->coarsened |= coarsened;
+
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,68 @@
+#ifndef EXTMAP_H
+#define EXTMAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define EXTMAP_DEFAULT_MAX_RUNS 4096
+
+// What a range of the device held when it was read back
+typedef enum {
+    EXT_GOOD,           // Matched the expected pattern
+    EXT_CHANGED,        // Differed in an unrecognizable way
+    EXT_OVERWRITTEN,    // Held the pattern of another offset (wraparound)
+    EXT_ZERO,           // Read back blank (all zeros or all ones)
+    EXT_UNREADABLE,     // Read request failed
+    EXT_WRITE_FAILED,   // Write request failed
+    EXT_NUM_STATES
+} ExtState;
+
+// Byte range [start, end) in one state
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    ExtState state;
+} Extent;
+
+// Sorted, non-overlapping runs. Adjacent runs of the same state are merged,
+// and gaps are ranges that were never tested. When the run count exceeds
+// max_runs, short runs between two bad runs are absorbed into their
+// neighbours, so the map stays bounded while never under-reporting bad space.
+typedef struct {
+    Extent *runs;
+    int count;
+    int capacity;
+    int max_runs;
+    int coarsened;      // Set once runs have been merged to stay under max_runs
+} ExtMap;
+
+void extmap_init(ExtMap *map, int max_runs);
+void extmap_free(ExtMap *map);
+
+// Mark [start, end) with state, replacing whatever was recorded there.
+// Appending in ascending order is O(1). Returns 0 when out of memory.
+int extmap_set(ExtMap *map, uint64_t start, uint64_t end, ExtState state);
+
+// Total bytes recorded in state
+uint64_t extmap_bytes(const ExtMap *map, ExtState state);
+
+// Start of the first run that is not EXT_GOOD, or UINT64_MAX if there is none
+uint64_t extmap_first_bad(const ExtMap *map);
+
+// Largest size, starting at 0 and rounded down to align, that a partition
+// can use without touching anything that failed. Untested gaps before the
+// first bad run count as good; the gap right before it does not.
+uint64_t extmap_safe_size(const ExtMap *map, uint64_t limit, uint64_t align);
+
+const char *extmap_state_name(ExtState state);
+
+// Print runs one per line; with bad_only, EXT_GOOD runs are left out
+void extmap_print(const ExtMap *map, FILE *out, int bad_only);
+
+// Save to or load from a text file: a "f3-extmap 1 C" header, where C is 1
+// if the map was coarsened and 0 if not, followed by one "start end state"
+// line per run. Loading ORs C into map->coarsened. Return 1 on success.
+int extmap_save(const ExtMap *map, const char *filename);
+int extmap_load(ExtMap *map, const char *filename);
+
+#endif /* EXTMAP_H */
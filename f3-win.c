@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "libf3.h"
+
+// Single front end for every F3 command. Built with F3_COMMAND set to one
+// of the command entry points, it becomes that standalone tool instead
+// (f3write.exe, f3read.exe, f3probe.exe).
+
+#ifndef F3_COMMAND
+
+typedef struct {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *summary;
+} Command;
+
+static const Command commands[] = {
+    {"write",   f3_write_main,   "Fill a drive with test files"},
+    {"read",    f3_read_main,    "Verify the test files written by f3 write"},
+    {"probe",   f3_probe_main,   "Probe a drive directly for its real capacity"},
+    {"certify", f3_certify_main, "Write and verify a whole drive in one pass"},
+    {"endurance", f3_endurance_main, "Rewrite a drive many times and track its error rate"},
+};
+
+#define NUM_COMMANDS (int)(sizeof(commands) / sizeof(commands[0]))
+
+static void print_usage(void) {
+    f3_print_header("F3 - Test flash memory capacity");
+    printf("Usage: f3.exe <command> [options]\n\n");
+    printf("Commands:\n");
+    for (int i = 0; i < NUM_COMMANDS; i++) {
+        printf("  %-11s%s\n", commands[i].name, commands[i].summary);
+    }
+    printf("\nRun f3.exe <command> without arguments for the options of a command.\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || strcmp(argv[1], "--help") == 0) {
+        print_usage();
+        return argc < 2 ? 1 : 0;
+    }
+    if (strcmp(argv[1], "--version") == 0) {
+        printf("f3 %s\n", F3_VERSION);
+        return 0;
+    }
+
+    for (int i = 0; i < NUM_COMMANDS; i++) {
+        if (strcmp(argv[1], commands[i].name) == 0) {
+            return commands[i].run(argc - 1, argv + 1);
+        }
+    }
+
+    printf("Error: Unknown command: %s\n\n", argv[1]);
+    print_usage();
+    return 1;
+}
+
+#else
+
+int main(int argc, char **argv) {
+    return F3_COMMAND(argc, argv);
+}
+
+#endif /* F3_COMMAND */
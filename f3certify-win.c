@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <windows.h>
+
+#include "libf3.h"
+
+#define CERTIFY_CHUNK_SIZE (8 << 20)  // Minimum bytes per transfer
+#define CERTIFY_DEFAULT_LAG_MB 1024  // Read back data written this far behind
+#define CERTIFY_CANARIES 64  // Re-checked points per sweep of the verified region
+#define CERTIFY_BAD_STREAK (256ULL * 1024 * 1024)  // Bad run that ends the test
+#define CERTIFY_AHEAD_CHUNKS 4  // Chunks the writer may run past lag while reads catch up
+
+// Read back [pos, pos + len) and record it in the map. On a read error,
+// mark the failing request and resume after it. Returns the bytes that did
+// not match or could not be read.
+static uint64_t verify_chunk(HANDLE hDevice, uint64_t pos, uint64_t len,
+                             unsigned char *expected, unsigned char *actual,
+                             const IoTune *tune, const F3Seed *seed, ExtMap *map) {
+    f3_fill_pattern(expected, (size_t)len, pos, seed);
+
+    uint64_t off = 0, bad = 0;
+    while (off < len) {
+        uint64_t done = iotune_transfer(hDevice, pos + off, actual + off, len - off, 0, tune);
+
+        bad += f3_verify_block(map, pos + off, expected + off, actual + off, (size_t)done,
+                               tune->logical_sector, seed);
+        off += done;
+
+        if (off < len) {
+            uint64_t skip = len - off < tune->io_size ? len - off : tune->io_size;
+            extmap_set(map, pos + off, pos + off + skip, EXT_UNREADABLE);
+            bad += skip;
+            off += skip;
+        }
+    }
+    return bad;
+}
+
+// State shared by the writer and the verifier thread. Each side publishes
+// how far it got and signals the other; a side that waits re-checks the
+// positions after every wakeup.
+typedef struct {
+    HANDLE hDevice;
+    IoTune tune;                  // Verifier's copy, with events of its own
+    const F3Seed *seed;
+    uint64_t surface;
+    uint64_t lag;
+    uint64_t ahead;               // Writer waits once this far past lag
+    size_t chunk_size;
+    int keep_going;
+    unsigned char *expected;
+    unsigned char *actual;
+    ExtMap *map;                  // Written by the verifier only
+    Progress *progress;
+
+    volatile LONG64 written;      // Bytes written, and flushed once all are
+    volatile LONG64 verified;     // Bytes verified
+    volatile LONG stop;           // Set by the verifier when the drive is shown fake
+    HANDLE advanced;              // Writer moved on
+    HANDLE drained;               // Verifier moved on or finished
+
+    // Verifier's findings, read once it has finished
+    uint64_t wrap;
+    uint64_t wrap_at;
+} CertifyState;
+
+// Read back what the writer finished lag bytes earlier, with its own
+// requests in flight alongside the writer's
+static DWORD WINAPI verify_thread(LPVOID param) {
+    CertifyState *c = (CertifyState *)param;
+    const IoTune *tune = &c->tune;
+    size_t sector = tune->physical_sector;
+    uint64_t verify_pos = 0, bad_streak = 0;
+    int canary = 0;
+
+    while (verify_pos < c->surface) {
+        // The last stretch is only read once the writer has flushed it
+        uint64_t written;
+        for (;;) {
+            written = (uint64_t)InterlockedCompareExchange64(&c->written, 0, 0);
+            if (written == c->surface || written - verify_pos > c->lag) {
+                break;
+            }
+            WaitForSingleObject(c->advanced, INFINITE);
+        }
+
+        uint64_t len = c->surface - verify_pos < c->chunk_size
+            ? c->surface - verify_pos : c->chunk_size;
+        if (verify_chunk(c->hDevice, verify_pos, len, c->expected, c->actual, tune, c->seed,
+                         c->map) == 0) {
+            bad_streak = 0;
+        } else {
+            progress_error(c->progress);
+            bad_streak += len;
+            if (!c->wrap) {
+                c->wrap = f3_wrap_distance(c->actual, c->expected, verify_pos, (size_t)len,
+                                           sector, c->seed, &c->wrap_at);
+            }
+        }
+        verify_pos += len;
+        progress_add(c->progress, len, 0);
+
+        // Re-check one sector of what already verified; only failures are
+        // recorded, so a later good read never hides an earlier bad one
+        uint64_t point = verify_pos / CERTIFY_CANARIES * canary;
+        point -= point % sector;
+        canary = (canary + 1) % CERTIFY_CANARIES;
+        f3_fill_pattern(c->expected, sector, point, c->seed);
+        if (iotune_transfer(c->hDevice, point, c->actual, sector, 0, tune) != sector) {
+            extmap_set(c->map, point, point + sector, EXT_UNREADABLE);
+        } else if (memcmp(c->expected, c->actual, sector) != 0) {
+            f3_verify_block(c->map, point, c->expected, c->actual, sector,
+                            tune->logical_sector, c->seed);
+            if (!c->wrap) {
+                c->wrap = f3_wrap_distance(c->actual, c->expected, point, sector, sector,
+                                           c->seed, &c->wrap_at);
+            }
+        }
+
+        InterlockedExchange64(&c->verified, (LONG64)verify_pos);
+        SetEvent(c->drained);
+
+        if (c->keep_going) {
+            continue;
+        }
+        if (c->wrap) {
+            progress_note(c->progress,
+                          "Data written at %llu MB reads back at %llu MB, stopping\n",
+                          (unsigned long long)((c->wrap_at + c->wrap) / (1024 * 1024)),
+                          (unsigned long long)(c->wrap_at / (1024 * 1024)));
+            break;
+        }
+        if (bad_streak >= CERTIFY_BAD_STREAK) {
+            progress_note(c->progress, "The last %llu MB read back failed, stopping\n",
+                          (unsigned long long)(bad_streak / (1024 * 1024)));
+            break;
+        }
+    }
+
+    InterlockedExchange(&c->stop, 1);
+    SetEvent(c->drained);
+    return 0;
+}
+
+// Write the pattern over the whole device while reading back what was
+// written lag bytes earlier, so data is verified only once it can no longer
+// be served from the device's cache. Reads run in a second thread on the
+// same handle, so the device always has both kinds of request queued. One
+// sector of the verified region is re-checked per chunk, which catches
+// writes wrapping around onto it soon after they pass the real capacity.
+FakeType f3_certify(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                    uint64_t lag, int keep_going, const F3Seed *seed, F3Result *result) {
+    f3_result_init(result);
+    size_t chunk_size = tune->io_size * tune->queue_depth;
+    if (chunk_size < CERTIFY_CHUNK_SIZE) {
+        chunk_size = CERTIFY_CHUNK_SIZE;
+    }
+    chunk_size = (size_t)iotune_align_up(tune, chunk_size);
+
+    BufPool pool;
+    chunk_size = f3_pool_create(&pool, chunk_size, 3, tune);
+    if (chunk_size == 0) {
+        return FAKE_TYPE_DAMAGED;
+    }
+    unsigned char *pattern = bufpool_acquire(&pool);
+
+    // Only whole sectors can be addressed
+    uint64_t surface = drive_size - drive_size % tune->logical_sector;
+    if (lag > surface / 2) {
+        lag = surface / 2;
+    }
+    Progress progress;
+
+    CertifyState c;
+    memset(&c, 0, sizeof(c));
+    c.hDevice = hDevice;
+    c.seed = seed;
+    c.surface = surface;
+    c.lag = lag;
+    c.ahead = (uint64_t)CERTIFY_AHEAD_CHUNKS * chunk_size;
+    c.chunk_size = chunk_size;
+    c.keep_going = keep_going;
+    c.expected = bufpool_acquire(&pool);
+    c.actual = bufpool_acquire(&pool);
+    c.map = &result->map;
+    c.progress = &progress;
+    c.advanced = CreateEvent(NULL, FALSE, FALSE, NULL);
+    c.drained = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!c.advanced || !c.drained || !iotune_clone(&c.tune, tune)) {
+        printf("Error: Could not create events (code %lu)\n", GetLastError());
+        if (c.advanced) CloseHandle(c.advanced);
+        if (c.drained) CloseHandle(c.drained);
+        f3_pool_destroy(&pool);
+        return FAKE_TYPE_DAMAGED;
+    }
+
+    printf("Certifying %.2f GB, verifying %llu MB behind the writes in %lu KB chunks...\n",
+           (double)surface / (1024 * 1024 * 1024), (unsigned long long)(lag / (1024 * 1024)),
+           (unsigned long)(chunk_size / 1024));
+
+    // Progress counts bytes written plus bytes verified
+    progress_start(&progress, "Certifying", 2 * surface, NULL, 0, "bad chunks");
+    HANDLE verifier = CreateThread(NULL, 0, verify_thread, &c, 0, NULL);
+    if (!verifier) {
+        progress_stop(&progress);
+        printf("Error: Could not start the verifier (code %lu)\n", GetLastError());
+        iotune_close(&c.tune);
+        CloseHandle(c.advanced);
+        CloseHandle(c.drained);
+        f3_pool_destroy(&pool);
+        return FAKE_TYPE_DAMAGED;
+    }
+
+    uint64_t write_pos = 0;
+    while (write_pos < surface && !c.stop) {
+        // Stay close enough to the verifier that a fake is caught early
+        if (write_pos - (uint64_t)InterlockedCompareExchange64(&c.verified, 0, 0) >
+            lag + c.ahead) {
+            WaitForSingleObject(c.drained, INFINITE);
+            continue;
+        }
+
+        uint64_t len = surface - write_pos < chunk_size ? surface - write_pos : chunk_size;
+        f3_fill_pattern(pattern, (size_t)len, write_pos, seed);
+        if (iotune_transfer(hDevice, write_pos, pattern, len, 1, tune) != len) {
+            progress_note(&progress, "Error writing at %llu MB\n",
+                          (unsigned long long)(write_pos / (1024 * 1024)));
+            result->write_errors++;
+        }
+        write_pos += len;
+        progress_add(&progress, len, 0);
+
+        if (write_pos == surface) {
+            FlushFileBuffers(hDevice);
+        }
+        InterlockedExchange64(&c.written, (LONG64)write_pos);
+        SetEvent(c.advanced);
+    }
+
+    WaitForSingleObject(verifier, INFINITE);
+    CloseHandle(verifier);
+    progress_stop(&progress);
+    printf("\n");
+
+    iotune_close(&c.tune);
+    CloseHandle(c.advanced);
+    CloseHandle(c.drained);
+    f3_pool_destroy(&pool);
+
+    // Verdict on what was verified before stopping
+    result->tested = (uint64_t)c.verified;
+    result->wrap = c.wrap;
+    return f3_judge_surface(result);
+}
+
+static void print_usage(const char *program_name) {
+    f3_print_header("F3 Certify - write and verify a flash drive in one pass");
+
+    printf("Usage: %s [options] drive_letter:\n", program_name);
+    printf("Options:\n");
+    printf("  --lag=MB          Verify data written this far back (default %d)\n",
+           CERTIFY_DEFAULT_LAG_MB);
+    printf("                    Use more than the drive could possibly cache\n");
+    printf("  --keep-going      Map the whole drive instead of stopping at a fake\n");
+    printf("  --save-map FILE   Save the map of good and bad ranges to FILE\n");
+    printf("  --no-tune         Skip I/O size calibration and use 1MB requests\n");
+    f3_print_mem_limit_usage(18);
+    printf("  --help            Display this help text\n");
+    printf("\nExample: %s J:\n", program_name);
+    printf("\nWARNING: Certify overwrites the whole drive.\n");
+    printf("         Please backup your data before using it.\n");
+}
+
+int f3_certify_main(int argc, char **argv) {
+    uint64_t lag = (uint64_t)CERTIFY_DEFAULT_LAG_MB * 1024 * 1024;
+    int keep_going = 0;
+    int no_tune = 0;
+    const char *map_file = NULL;
+    char drive_letter = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--lag=", 6) == 0) {
+            long long lag_mb = atoll(argv[i] + 6);
+            if (lag_mb <= 0) {
+                printf("Error: Invalid lag: %s\n", argv[i]);
+                return 1;
+            }
+            lag = (uint64_t)lag_mb * 1024 * 1024;
+        } else if (strcmp(argv[i], "--keep-going") == 0) {
+            keep_going = 1;
+        } else if (strcmp(argv[i], "--save-map") == 0 && i + 1 < argc) {
+            map_file = argv[++i];
+        } else if (strncmp(argv[i], "--mem-limit=", 12) == 0) {
+            if (!f3_parse_mem_limit(argv[i] + 12)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-tune") == 0) {
+            no_tune = 1;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && (argv[i][1] == '\0' || argv[i][1] == ':')) {
+            drive_letter = argv[i][0];
+        } else {
+            printf("Error: Unknown argument: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!drive_letter) {
+        printf("Error: Drive letter not specified\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    f3_print_header("F3 Certify for Windows");
+
+    HANDLE hDevice = f3_open_drive(drive_letter, 1);
+    if (hDevice == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        printf("Error opening drive %c: (code %lu)\n", drive_letter, error);
+        printf("Make sure you run this program with administrator privileges\n");
+        printf("and that the drive is not in use by another program.\n");
+        return 1;
+    }
+
+    uint64_t drive_size = f3_get_drive_size(hDevice);
+    if (drive_size == 0) {
+        printf("Error: Could not determine drive size\n");
+        CloseHandle(hDevice);
+        return 1;
+    }
+
+    IoTune tune;
+    iotune_defaults(&tune);
+    f3_tune_drive(hDevice, drive_size, !no_tune, &tune);
+    iotune_print(&tune);
+    printf("\n");
+
+    if (!f3_lock_volume(hDevice)) {
+        printf("Warning: Could not lock drive %c:, writes to areas in use may fail\n\n",
+               drive_letter);
+    }
+
+    F3Seed seed;
+    f3_seed_generate(&seed);
+    F3Result result;
+    f3_certify(hDevice, drive_size, &tune, lag, keep_going, &seed, &result);
+    iotune_close(&tune);
+    CloseHandle(hDevice);
+
+    f3_print_result(&result, map_file);
+    int status = result.verdict == FAKE_TYPE_GOOD ? 0 : 1;
+    f3_result_free(&result);
+    return status;
+}
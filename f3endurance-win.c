@@ -0,0 +1,588 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <windows.h>
+
+#include "libf3.h"
+
+#define ENDURANCE_CHUNK_SIZE (8 << 20)  // Minimum bytes per transfer
+#define ENDURANCE_DEFAULT_CYCLES 10
+#define ENDURANCE_DEFAULT_LAG_MB 1024  // Check fresh data written this far behind
+#define ENDURANCE_DWELL_INTERVAL 60  // Seconds between checks while the data idles
+#define ENDURANCE_DWELL_SLICE (64ULL << 20)  // Bytes re-read at each of those checks
+#define ENDURANCE_AHEAD_CHUNKS 4  // Chunks checked ahead of, or lagging, the writes
+
+// Bytes checked and found bad in one cycle
+typedef struct {
+    uint64_t fresh_checked;
+    uint64_t fresh_bad;
+    uint64_t retained_checked;
+    uint64_t retained_bad;
+    uint64_t idle_checked;      // Re-read while the data sat idle (--dwell)
+    uint64_t idle_bad;
+    int write_errors;
+} CycleStats;
+
+// Pattern seed of a cycle; every cycle gets an unrelated pattern, so data
+// left over from an earlier cycle never passes for the current one
+static F3Seed cycle_seed(const F3Seed *session, int cycle) {
+    F3Seed seed = *session;
+    seed.lo ^= f3_pattern_word((uint64_t)cycle);
+    return seed;
+}
+
+// Read [pos, pos + len) and count the bytes of sectors that do not hold
+// the pattern for seed. An unreadable rest of the chunk counts as bad.
+// Only failures are recorded in the map, so a later good pass never hides
+// an earlier bad one.
+static uint64_t count_bad(HANDLE hDevice, uint64_t pos, uint64_t len, const F3Seed *seed,
+                          unsigned char *expected, unsigned char *actual, const IoTune *tune,
+                          ExtMap *map) {
+    f3_fill_pattern(expected, (size_t)len, pos, seed);
+    uint64_t done = iotune_transfer(hDevice, pos, actual, len, 0, tune);
+    uint64_t bad = len - done;
+    extmap_set(map, pos + done, pos + len, EXT_UNREADABLE);
+
+    if (memcmp(expected, actual, (size_t)done) != 0) {
+        for (uint64_t s = 0; s < done; s += tune->logical_sector) {
+            uint64_t n = done - s < tune->logical_sector ? done - s : tune->logical_sector;
+            if (memcmp(expected + s, actual + s, (size_t)n) != 0) {
+                extmap_set(map, pos + s, pos + s + n,
+                           f3_classify_sector(actual + s, (size_t)n, seed));
+                bad += n;
+            }
+        }
+    }
+    return bad;
+}
+
+static double error_rate(uint64_t bad, uint64_t checked) {
+    return checked > 0 ? (double)bad / checked : 0;
+}
+
+// Shared between the writer and the verifier thread of one cycle
+typedef struct {
+    HANDLE hDevice;
+    const IoTune *tune;        // The verifier's own, cloned from the writer's
+    uint64_t surface;
+    uint64_t lag;
+    uint64_t ahead;            // How far the retained check may run before the writes
+    size_t chunk_size;
+    int write;
+    int check_previous;
+    F3Seed previous;           // Pattern of the data about to be overwritten
+    F3Seed seed;               // This cycle's pattern
+    unsigned char *expected;
+    unsigned char *actual;
+    ExtMap *map;
+    Progress *progress;
+    CycleStats *stats;         // The verifier fills in all but write_errors
+    volatile LONG64 written;   // Written below this
+    volatile LONG64 retained;  // Previous cycle's data checked below this
+    volatile LONG64 verified;  // This cycle's data checked below this
+    HANDLE advanced;           // Set by the writer after each chunk
+    HANDLE drained;            // Set by the verifier after each chunk
+} CycleState;
+
+// Verifier thread: check the previous cycle's data just ahead of the
+// writes, and this cycle's data once it is lag bytes behind them
+static DWORD WINAPI verify_thread(LPVOID arg) {
+    CycleState *c = (CycleState *)arg;
+    uint64_t retained_pos = c->check_previous ? 0 : c->surface;
+    uint64_t verify_pos = c->write ? 0 : c->surface;
+
+    while (retained_pos < c->surface || verify_pos < c->surface) {
+        uint64_t written = (uint64_t)InterlockedCompareExchange64(&c->written, 0, 0);
+
+        uint64_t len = c->surface - verify_pos < c->chunk_size ? c->surface - verify_pos
+                                                                : c->chunk_size;
+        if (verify_pos < c->surface && written >= verify_pos + len &&
+            (written == c->surface || written - verify_pos > c->lag)) {
+            uint64_t bad = count_bad(c->hDevice, verify_pos, len, &c->seed, c->expected,
+                                     c->actual, c->tune, c->map);
+            c->stats->fresh_checked += len;
+            c->stats->fresh_bad += bad;
+            if (bad > 0) {
+                progress_error(c->progress);
+            }
+            verify_pos += len;
+            progress_add(c->progress, len, 0);
+            InterlockedExchange64(&c->verified, (LONG64)verify_pos);
+            SetEvent(c->drained);
+            continue;
+        }
+
+        // The previous cycle's data has aged a whole cycle by now
+        len = c->surface - retained_pos < c->chunk_size ? c->surface - retained_pos
+                                                         : c->chunk_size;
+        if (retained_pos < c->surface && (!c->write || retained_pos < written + c->ahead)) {
+            uint64_t bad = count_bad(c->hDevice, retained_pos, len, &c->previous, c->expected,
+                                     c->actual, c->tune, c->map);
+            c->stats->retained_checked += len;
+            c->stats->retained_bad += bad;
+            if (bad > 0) {
+                progress_error(c->progress);
+            }
+            retained_pos += len;
+            progress_add(c->progress, len, 0);
+            InterlockedExchange64(&c->retained, (LONG64)retained_pos);
+            SetEvent(c->drained);
+            continue;
+        }
+
+        WaitForSingleObject(c->advanced, INFINITE);
+    }
+    return 0;
+}
+
+// One pass over the device: check the previous cycle's data, overwrite it
+// with this cycle's pattern, and check that lag bytes later. The checks run
+// on a second thread while the writes are in flight, as in f3_certify.
+// Without write, only checks what the given cycle left behind. The buffers
+// hold chunk_size bytes each. Returns 0 if the verifier could not start.
+static int run_cycle(HANDLE hDevice, uint64_t surface, const IoTune *tune,
+                     const IoTune *verify_tune, uint64_t lag, const F3Seed *session,
+                     int cycle, int write, int check_previous, size_t chunk_size,
+                     unsigned char *pattern, unsigned char *expected, unsigned char *actual,
+                     F3Result *result, CycleStats *stats) {
+    char label[32];
+    if (write) {
+        snprintf(label, sizeof(label), "Cycle %d", cycle);
+    } else {
+        snprintf(label, sizeof(label), "Final check");
+    }
+    uint64_t total = (check_previous ? surface : 0) + (write ? 2 * surface : 0);
+    Progress progress;
+
+    memset(stats, 0, sizeof(*stats));
+    CycleState c;
+    memset(&c, 0, sizeof(c));
+    c.hDevice = hDevice;
+    c.tune = verify_tune;
+    c.surface = surface;
+    c.lag = lag;
+    c.ahead = (uint64_t)ENDURANCE_AHEAD_CHUNKS * chunk_size;
+    c.chunk_size = chunk_size;
+    c.write = write;
+    c.check_previous = check_previous;
+    c.previous = cycle_seed(session, write ? cycle - 1 : cycle);
+    c.seed = cycle_seed(session, cycle);
+    c.expected = expected;
+    c.actual = actual;
+    c.map = &result->map;
+    c.progress = &progress;
+    c.stats = stats;
+    c.advanced = CreateEvent(NULL, FALSE, FALSE, NULL);
+    c.drained = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (!c.advanced || !c.drained) {
+        printf("Error: Could not create events (code %lu)\n", GetLastError());
+        if (c.advanced) CloseHandle(c.advanced);
+        if (c.drained) CloseHandle(c.drained);
+        return 0;
+    }
+
+    progress_start(&progress, label, total, NULL, 0, "bad chunks");
+    HANDLE verifier = CreateThread(NULL, 0, verify_thread, &c, 0, NULL);
+    if (!verifier) {
+        progress_stop(&progress);
+        printf("Error: Could not start the verifier (code %lu)\n", GetLastError());
+        CloseHandle(c.advanced);
+        CloseHandle(c.drained);
+        return 0;
+    }
+
+    uint64_t write_pos = 0;
+    while (write && write_pos < surface) {
+        uint64_t len = surface - write_pos < chunk_size ? surface - write_pos : chunk_size;
+
+        // Overwrite only data already checked, and stay close enough to the
+        // fresh checks that they keep their lag
+        if ((check_previous &&
+             (uint64_t)InterlockedCompareExchange64(&c.retained, 0, 0) < write_pos + len) ||
+            write_pos - (uint64_t)InterlockedCompareExchange64(&c.verified, 0, 0) >
+            lag + c.ahead) {
+            WaitForSingleObject(c.drained, INFINITE);
+            continue;
+        }
+
+        f3_fill_pattern(pattern, (size_t)len, write_pos, &c.seed);
+        uint64_t done = iotune_transfer(hDevice, write_pos, pattern, len, 1, tune);
+        if (done != len) {
+            extmap_set(&result->write_map, write_pos + done, write_pos + len,
+                       EXT_WRITE_FAILED);
+            stats->write_errors++;
+        }
+        write_pos += len;
+        progress_add(&progress, len, 0);
+
+        if (write_pos == surface) {
+            FlushFileBuffers(hDevice);
+        }
+        InterlockedExchange64(&c.written, (LONG64)write_pos);
+        SetEvent(c.advanced);
+    }
+
+    WaitForSingleObject(verifier, INFINITE);
+    CloseHandle(verifier);
+    progress_stop(&progress);
+    CloseHandle(c.advanced);
+    CloseHandle(c.drained);
+    return 1;
+}
+
+// Leave the cycle's data idle for minutes, waking up every
+// ENDURANCE_DWELL_INTERVAL seconds to re-read the next slice of it, so
+// retention is watched while the data ages and not only once the next
+// cycle is about to overwrite it. Reads barely disturb the cells, so the
+// data still ages between checks.
+static void dwell(HANDLE hDevice, uint64_t surface, const IoTune *tune, const F3Seed *session,
+                  int cycle, double minutes, size_t chunk_size, unsigned char *expected,
+                  unsigned char *actual, ExtMap *map, CycleStats *stats) {
+    F3Seed seed = cycle_seed(session, cycle);
+    uint64_t slice = ENDURANCE_DWELL_SLICE < surface ? ENDURANCE_DWELL_SLICE : surface;
+    uint64_t cursor = 0;
+
+    printf("Idling %.0f minutes, re-reading %llu MB every %d seconds...\n", minutes,
+           (unsigned long long)(slice / (1024 * 1024)), ENDURANCE_DWELL_INTERVAL);
+
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    for (;;) {
+        QueryPerformanceCounter(&now);
+        double left = minutes * 60 - (double)(now.QuadPart - start.QuadPart) / frequency.QuadPart;
+        if (left <= 0) {
+            break;
+        }
+        if (left < ENDURANCE_DWELL_INTERVAL) {
+            Sleep((DWORD)(left * 1000));
+            break;
+        }
+        Sleep(ENDURANCE_DWELL_INTERVAL * 1000);
+
+        // The next slice, wrapping around so long dwells keep re-reading
+        for (uint64_t done = 0; done < slice; ) {
+            if (cursor >= surface) {
+                cursor = 0;
+            }
+            uint64_t len = surface - cursor < chunk_size ? surface - cursor : chunk_size;
+            if (len > slice - done) {
+                len = slice - done;
+            }
+            stats->idle_bad += count_bad(hDevice, cursor, len, &seed, expected, actual, tune,
+                                         map);
+            stats->idle_checked += len;
+            cursor += len;
+            done += len;
+        }
+    }
+}
+
+FakeType f3_endurance(HANDLE hDevice, uint64_t drive_size, const IoTune *tune, uint64_t lag,
+                      int cycles, double hours, double dwell_minutes, const F3Seed *seed,
+                      const char *log_file, F3Result *result) {
+    f3_result_init(result);
+    size_t chunk_size = tune->io_size * tune->queue_depth;
+    if (chunk_size < ENDURANCE_CHUNK_SIZE) {
+        chunk_size = ENDURANCE_CHUNK_SIZE;
+    }
+    chunk_size = (size_t)iotune_align_up(tune, chunk_size);
+
+    // Buffers are allocated once, so the footprint stays flat however long it runs
+    BufPool pool;
+    chunk_size = f3_pool_create(&pool, chunk_size, 3, tune);
+    if (chunk_size == 0) {
+        return FAKE_TYPE_DAMAGED;
+    }
+    unsigned char *pattern = bufpool_acquire(&pool);
+    unsigned char *expected = bufpool_acquire(&pool);
+    unsigned char *actual = bufpool_acquire(&pool);
+
+    // The verifier thread needs request events of its own
+    IoTune verify_tune;
+    if (!iotune_clone(&verify_tune, tune)) {
+        printf("Error: Could not create events (code %lu)\n", GetLastError());
+        f3_pool_destroy(&pool);
+        return FAKE_TYPE_DAMAGED;
+    }
+
+    FILE *log = NULL;
+    if (log_file) {
+        log = fopen(log_file, "a");
+        if (!log) {
+            printf("Warning: Could not open log file %s\n", log_file);
+        } else {
+            fprintf(log, "time,cycle,elapsed_s,written_mb,write_errors,"
+                         "fresh_bad_mb,fresh_error_rate,retained_bad_mb,retained_error_rate,"
+                         "idle_bad_mb,idle_error_rate\n");
+            fflush(log);
+        }
+    }
+
+    // Only whole sectors can be addressed
+    uint64_t surface = drive_size - drive_size % tune->logical_sector;
+    if (lag > surface / 2) {
+        lag = surface / 2;
+    }
+
+    printf("Endurance test over %.2f GB", (double)surface / (1024 * 1024 * 1024));
+    if (cycles < INT_MAX) {
+        printf(", %d cycles", cycles);
+    }
+    if (hours > 0) {
+        printf(", at most %.1f hours", hours);
+    }
+    if (dwell_minutes > 0) {
+        printf(", %.0f minutes idle between cycles", dwell_minutes);
+    }
+    printf("\n\n");
+
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    double first_rate = -1, last_rate = 0;
+    int clean = 1;
+    int cycle;
+    for (cycle = 1; cycle <= cycles; cycle++) {
+        CycleStats stats;
+        if (!run_cycle(hDevice, surface, tune, &verify_tune, lag, seed, cycle, 1, cycle > 1,
+                       chunk_size, pattern, expected, actual, result, &stats)) {
+            if (log) {
+                fclose(log);
+            }
+            iotune_close(&verify_tune);
+            f3_pool_destroy(&pool);
+            return FAKE_TYPE_DAMAGED;
+        }
+        result->write_errors += stats.write_errors;
+
+        QueryPerformanceCounter(&now);
+        double elapsed = (double)(now.QuadPart - start.QuadPart) / frequency.QuadPart;
+        int out_of_time = hours > 0 && elapsed >= hours * 3600;
+        if (dwell_minutes > 0 && !out_of_time) {
+            dwell(hDevice, surface, tune, seed, cycle, dwell_minutes, chunk_size,
+                  expected, actual, &result->map, &stats);
+        }
+        double fresh = error_rate(stats.fresh_bad, stats.fresh_checked);
+        double retained = error_rate(stats.retained_bad, stats.retained_checked);
+        double idle = error_rate(stats.idle_bad, stats.idle_checked);
+
+        printf("Cycle %d done after %.2f hours: %.6f%% fresh errors, "
+               "%.6f%% retained errors, ", cycle, elapsed / 3600, fresh * 100, retained * 100);
+        if (stats.idle_checked > 0) {
+            printf("%.6f%% errors while idle, ", idle * 100);
+        }
+        printf("%d write errors\n\n", stats.write_errors);
+        if (log) {
+            fprintf(log, "%lld,%d,%.0f,%llu,%d,%.2f,%.9f,%.2f,%.9f,%.2f,%.9f\n",
+                    (long long)time(NULL), cycle, elapsed,
+                    (unsigned long long)(surface / (1024 * 1024)), stats.write_errors,
+                    stats.fresh_bad / (1024.0 * 1024.0), fresh,
+                    stats.retained_bad / (1024.0 * 1024.0), retained,
+                    stats.idle_bad / (1024.0 * 1024.0), idle);
+            fflush(log);
+        }
+
+        if (stats.fresh_bad || stats.retained_bad || stats.idle_bad || stats.write_errors) {
+            clean = 0;
+        }
+        if (first_rate < 0) {
+            first_rate = fresh;
+        }
+        last_rate = fresh > retained ? fresh : retained;
+        if (idle > last_rate) {
+            last_rate = idle;
+        }
+
+        if (out_of_time) {
+            break;
+        }
+    }
+    if (cycle > cycles) {
+        cycle = cycles;
+    }
+
+    // The last cycle's data is checked once more after it has aged
+    CycleStats stats;
+    if (!run_cycle(hDevice, surface, tune, &verify_tune, lag, seed, cycle, 0, 1, chunk_size,
+                   pattern, expected, actual, result, &stats)) {
+        if (log) {
+            fclose(log);
+        }
+        iotune_close(&verify_tune);
+        f3_pool_destroy(&pool);
+        return FAKE_TYPE_DAMAGED;
+    }
+    double retained = error_rate(stats.retained_bad, stats.retained_checked);
+    printf("Last cycle's data after aging: %.6f%% retained errors\n", retained * 100);
+    if (log) {
+        fprintf(log, "%lld,final,,0,0,0,0,%.2f,%.9f,0,0\n", (long long)time(NULL),
+                stats.retained_bad / (1024.0 * 1024.0), retained);
+        fclose(log);
+    }
+    if (stats.retained_bad) {
+        clean = 0;
+    }
+    if (retained > last_rate) {
+        last_rate = retained;
+    }
+
+    iotune_close(&verify_tune);
+    f3_pool_destroy(&pool);
+
+    if (clean) {
+        printf("No errors in %d cycles\n", cycle);
+    } else {
+        printf("Error rate went from %.6f%% in the first cycle to %.6f%% at the end\n",
+               first_rate * 100, last_rate * 100);
+    }
+    printf("\n");
+
+    result->tested = surface;
+    result->usable_size = extmap_safe_size(&result->map, surface, 1024 * 1024);
+    if (clean) {
+        result->verdict = FAKE_TYPE_GOOD;
+    } else {
+        result->verdict = FAKE_TYPE_DAMAGED;
+        result->note = "does not retain data reliably";
+    }
+    return result->verdict;
+}
+
+static void print_usage(const char *program_name) {
+    f3_print_header("F3 Endurance - repeated rewrite and retention test");
+
+    printf("Usage: %s [options] drive_letter:\n", program_name);
+    printf("Options:\n");
+    printf("  --cycles=N        Rewrite the drive N times (default %d)\n",
+           ENDURANCE_DEFAULT_CYCLES);
+    printf("  --hours=H         Stop after the cycle that ends past H hours\n");
+    printf("  --dwell=MINUTES   Leave the data idle this long between cycles,\n");
+    printf("                    re-reading part of it every minute\n");
+    printf("  --lag=MB          Check fresh data written this far back (default %d)\n",
+           ENDURANCE_DEFAULT_LAG_MB);
+    printf("  --log FILE        Append one CSV line per cycle to FILE\n");
+    printf("  --save-map FILE   Save the map of ranges that failed to FILE\n");
+    printf("  --no-tune         Skip I/O size calibration and use 1MB requests\n");
+    f3_print_mem_limit_usage(18);
+    printf("  --help            Display this help text\n");
+    printf("\nExample: %s --cycles=100 --log wear.csv J:\n", program_name);
+    printf("\nWARNING: The endurance test overwrites the whole drive many times.\n");
+    printf("         Please backup your data before using it.\n");
+}
+
+int f3_endurance_main(int argc, char **argv) {
+    int cycles = 0;  // Default depends on --hours
+    double hours = 0;
+    double dwell = 0;
+    uint64_t lag = (uint64_t)ENDURANCE_DEFAULT_LAG_MB * 1024 * 1024;
+    int no_tune = 0;
+    const char *log_file = NULL;
+    const char *map_file = NULL;
+    char drive_letter = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--cycles=", 9) == 0) {
+            cycles = atoi(argv[i] + 9);
+            if (cycles <= 0) {
+                printf("Error: Invalid number of cycles: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--hours=", 8) == 0) {
+            hours = atof(argv[i] + 8);
+            if (hours <= 0) {
+                printf("Error: Invalid number of hours: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--dwell=", 8) == 0) {
+            dwell = atof(argv[i] + 8);
+            if (dwell < 0) {
+                printf("Error: Invalid dwell time: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--lag=", 6) == 0) {
+            long long lag_mb = atoll(argv[i] + 6);
+            if (lag_mb <= 0) {
+                printf("Error: Invalid lag: %s\n", argv[i]);
+                return 1;
+            }
+            lag = (uint64_t)lag_mb * 1024 * 1024;
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_file = argv[++i];
+        } else if (strcmp(argv[i], "--save-map") == 0 && i + 1 < argc) {
+            map_file = argv[++i];
+        } else if (strncmp(argv[i], "--mem-limit=", 12) == 0) {
+            if (!f3_parse_mem_limit(argv[i] + 12)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-tune") == 0) {
+            no_tune = 1;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else if (argv[i][0] != '-' && (argv[i][1] == '\0' || argv[i][1] == ':')) {
+            drive_letter = argv[i][0];
+        } else {
+            printf("Error: Unknown argument: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!drive_letter) {
+        printf("Error: Drive letter not specified\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // With only a time limit, keep cycling until it runs out
+    if (cycles == 0) {
+        cycles = hours > 0 ? INT_MAX : ENDURANCE_DEFAULT_CYCLES;
+    }
+
+    f3_print_header("F3 Endurance for Windows");
+
+    HANDLE hDevice = f3_open_drive(drive_letter, 1);
+    if (hDevice == INVALID_HANDLE_VALUE) {
+        DWORD error = GetLastError();
+        printf("Error opening drive %c: (code %lu)\n", drive_letter, error);
+        printf("Make sure you run this program with administrator privileges\n");
+        printf("and that the drive is not in use by another program.\n");
+        return 1;
+    }
+
+    uint64_t drive_size = f3_get_drive_size(hDevice);
+    if (drive_size == 0) {
+        printf("Error: Could not determine drive size\n");
+        CloseHandle(hDevice);
+        return 1;
+    }
+
+    IoTune tune;
+    iotune_defaults(&tune);
+    f3_tune_drive(hDevice, drive_size, !no_tune, &tune);
+    iotune_print(&tune);
+    printf("\n");
+
+    if (!f3_lock_volume(hDevice)) {
+        printf("Warning: Could not lock drive %c:, writes to areas in use may fail\n\n",
+               drive_letter);
+    }
+
+    F3Seed seed;
+    F3Result result;
+    f3_seed_generate(&seed);
+    FakeType verdict = f3_endurance(hDevice, drive_size, &tune, lag, cycles, hours, dwell,
+                                    &seed, log_file, &result);
+
+    iotune_close(&tune);
+    CloseHandle(hDevice);
+
+    f3_print_result(&result, map_file);
+    f3_result_free(&result);
+    return verdict == FAKE_TYPE_GOOD ? 0 : 1;
+}
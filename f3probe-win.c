@@ -3,85 +3,41 @@
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 #include <windows.h>
 
-#define VERSION "9.0-win"
-#define SECTOR_SIZE 512
-#define BLOCK_SIZE (1 << 20)  // 1MB blocks
-#define PATTERN_SIZE 64
+#include "libf3.h"
+#include "quickplan.h"
 
-// Simplified fake type enum
-typedef enum {
-    FAKE_TYPE_GOOD,
-    FAKE_TYPE_POSSIBLY_FAKE,
-    FAKE_TYPE_DAMAGED
-} FakeType;
-
-// Random pattern generator
-void fill_pattern(unsigned char *buffer, size_t size, uint64_t seed) {
-    srand((unsigned int)seed);
-    for (size_t i = 0; i < size; i++) {
-        buffer[i] = rand() % 256;
-    }
-}
-
-// Get drive size in bytes
-uint64_t get_drive_size(HANDLE hDevice) {
-    DISK_GEOMETRY_EX diskGeometry;
-    DWORD bytesReturned;
-
-    if (DeviceIoControl(
-        hDevice,
-        IOCTL_DISK_GET_DRIVE_GEOMETRY_EX,
-        NULL,
-        0,
-        &diskGeometry,
-        sizeof(diskGeometry),
-        &bytesReturned,
-        NULL))
-    {
-        return diskGeometry.DiskSize.QuadPart;
-    }
-
-    // Alternative method if the above fails
-    GET_LENGTH_INFORMATION lengthInfo;
-    if (DeviceIoControl(
-        hDevice,
-        IOCTL_DISK_GET_LENGTH_INFO,
-        NULL,
-        0,
-        &lengthInfo,
-        sizeof(lengthInfo),
-        &bytesReturned,
-        NULL))
-    {
-        return lengthInfo.Length.QuadPart;
-    }
-
-    // Fall back to seeking to end if both methods fail
-    LARGE_INTEGER distanceToMove;
-    distanceToMove.QuadPart = 0;
-    SetFilePointerEx(hDevice, distanceToMove, &distanceToMove, FILE_END);
-    return distanceToMove.QuadPart;
-}
+#define MIN_BLOCK_SIZE (1 << 20)  // Smallest block tested at each point
+#define SAMPLE_BATCH 8  // Points written before one flush and their read-back
+#define FULL_CHUNK_SIZE (8 << 20)  // Minimum bytes per full-surface transfer
+#define QUICK_BLOCK_SIZE (1 << 20)  // Bytes tested at each quick probe point
+#define QUICK_MAX_BATCH 64
+#define QUICK_BAD_FRACTION 0.05  // Scattered damage a GENUINE verdict rules out
 
 // Test for fake flash by writing and reading pattern
-FakeType test_drive(HANDLE hDevice, uint64_t drive_size, int destructive, int time_ops) {
+FakeType f3_probe_sample(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                         int destructive, int time_ops, const F3Seed *seed,
+                         F3Result *result) {
     const uint64_t test_interval = drive_size / 64;  // Test at 64 points
     const uint64_t min_test_interval = 64 * 1024 * 1024; // Min 64MB between tests
+    f3_result_init(result);
+    ExtMap *map = &result->map;
     
-    unsigned char *write_buffer = (unsigned char *)malloc(BLOCK_SIZE);
-    unsigned char *read_buffer = (unsigned char *)malloc(BLOCK_SIZE);
+    // Test blocks cover at least one tuned request and stay sector aligned,
+    // as FILE_FLAG_NO_BUFFERING requires
+    size_t block_size = tune->io_size > MIN_BLOCK_SIZE ? tune->io_size : MIN_BLOCK_SIZE;
+    block_size = (size_t)iotune_align_up(tune, block_size);
     
-    if (!write_buffer || !read_buffer) {
-        printf("Error: Out of memory\n");
-        if (write_buffer) free(write_buffer);
-        if (read_buffer) free(read_buffer);
+    BufPool pool;
+    block_size = f3_pool_create(&pool, block_size, 2, tune);
+    if (block_size == 0) {
         return FAKE_TYPE_DAMAGED;
     }
+    unsigned char *write_buffer = bufpool_acquire(&pool);
+    unsigned char *read_buffer = bufpool_acquire(&pool);
     
-    LARGE_INTEGER li;
-    DWORD bytesWritten, bytesRead;
     int mismatch_count = 0;
     int test_count = 0;
     uint64_t first_mismatch_pos = 0;
@@ -98,155 +54,463 @@ FakeType test_drive(HANDLE hDevice, uint64_t drive_size, int destructive, int ti
     printf("Drive size: %.2f GB\n", (double)drive_size / (1024*1024*1024));
     
     // Skip first 1MB which might contain partition table/filesystem data
-    uint64_t pos = 1024 * 1024;
+    uint64_t pos = iotune_align_up(tune, 1024 * 1024);
     uint64_t step = test_interval > min_test_interval ? test_interval : min_test_interval;
+    step -= step % tune->physical_sector;
+    
+    uint64_t total_points = pos + block_size <= drive_size
+        ? (drive_size - block_size - pos) / step + 1 : 0;
+    Progress progress;
+    progress_start(&progress, "Probing", total_points * block_size, "points", total_points,
+                   destructive ? "bad points" : "read errors");
 
-    while (pos + BLOCK_SIZE <= drive_size) {
-        // Generate test pattern
-        fill_pattern(write_buffer, BLOCK_SIZE, pos);
-        
-        // Set file pointer
-        li.QuadPart = pos;
-        if (!SetFilePointerEx(hDevice, li, NULL, FILE_BEGIN)) {
-            printf("Error setting file pointer to position %llu\n", pos);
-            error_count++;
-            pos += step;
-            continue;
+    while (pos + block_size <= drive_size && mismatch_count < 3) {
+        // Points are written in batches with one flush per batch, rather
+        // than a synchronous round trip to the device after every write
+        uint64_t batch[SAMPLE_BATCH];
+        int written[SAMPLE_BATCH];
+        int count = 0;
+        for (; count < SAMPLE_BATCH && pos + block_size <= drive_size; pos += step) {
+            written[count] = 1;
+            batch[count++] = pos;
         }
         
         if (destructive) {
-            // Write pattern
+            // Write pattern; the flush counts as write time
+            QueryPerformanceCounter(&start);
+            
+            for (int i = 0; i < count; i++) {
+                f3_fill_pattern(write_buffer, block_size, batch[i], seed);
+                if (iotune_transfer(hDevice, batch[i], write_buffer, block_size, 1, tune) !=
+                    block_size) {
+                    progress_note(&progress, "Error writing at position %llu\n",
+                                  (unsigned long long)batch[i]);
+                    extmap_set(map, batch[i], batch[i] + block_size, EXT_WRITE_FAILED);
+                    progress_add(&progress, block_size, 1);
+                    progress_error(&progress);
+                    error_count++;
+                    result->write_errors++;
+                    written[i] = 0;
+                }
+            }
+            FlushFileBuffers(hDevice);
+            
+            QueryPerformanceCounter(&end);
+            write_seconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+        }
+        
+        for (int i = 0; i < count && mismatch_count < 3; i++) {
+            uint64_t point = batch[i];
+            if (!written[i]) {
+                continue;
+            }
+            
+            // Read data
             QueryPerformanceCounter(&start);
             
-            if (!WriteFile(hDevice, write_buffer, BLOCK_SIZE, &bytesWritten, NULL) || 
-                bytesWritten != BLOCK_SIZE) {
-                printf("Error writing at position %llu\n", pos);
+            if (iotune_transfer(hDevice, point, read_buffer, block_size, 0, tune) != block_size) {
+                progress_note(&progress, "Error reading at position %llu\n",
+                              (unsigned long long)point);
+                if (destructive) {
+                    extmap_set(map, point, point + block_size, EXT_UNREADABLE);
+                }
+                progress_add(&progress, block_size, 1);
+                progress_error(&progress);
                 error_count++;
-                pos += step;
                 continue;
             }
             
             QueryPerformanceCounter(&end);
-            write_seconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+            read_seconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+            
+            if (destructive) {
+                // Compare data; if we find several mismatches, we can conclude it's fake
+                f3_fill_pattern(write_buffer, block_size, point, seed);
+                if (f3_verify_block(map, point, write_buffer, read_buffer, block_size,
+                                    tune->logical_sector, seed) != 0) {
+                    mismatch_count++;
+                    if (first_mismatch_pos == 0) {
+                        first_mismatch_pos = point;
+                    }
+                    progress_error(&progress);
+                }
+            }
+            
+            test_count++;
+            progress_add(&progress, block_size, 1);
+        }
+    }
+    
+    progress_stop(&progress);
+    printf("\nTest complete. %d points tested.\n", test_count);
+    
+    if (time_ops) {
+        printf("Write time: %.2f seconds\n", write_seconds);
+        printf("Read time: %.2f seconds\n", read_seconds);
+        printf("Average write speed: %.2f MB/s\n", 
+               ((double)block_size * test_count) / (write_seconds * 1024 * 1024));
+        printf("Average read speed: %.2f MB/s\n", 
+               ((double)block_size * test_count) / (read_seconds * 1024 * 1024));
+    }
+    
+    f3_pool_destroy(&pool);
+    
+    result->tested = drive_size;
+    result->usable_size = extmap_safe_size(map, drive_size, 1024 * 1024);
+    if (error_count > test_count / 2) {
+        result->verdict = FAKE_TYPE_DAMAGED;
+        result->note = "too many I/O errors";
+    } else if (mismatch_count > 0) {
+        result->verdict = FAKE_TYPE_POSSIBLY_FAKE;
+        result->capacity_low = first_mismatch_pos;
+        result->capacity_high = first_mismatch_pos;
+    } else {
+        result->verdict = FAKE_TYPE_GOOD;
+    }
+    return result->verdict;
+}
 
-            // Flush to ensure data is written
-            FlushFileBuffers(hDevice);
+// Write the pattern over the whole device, then read everything back and
+// compare. Verifying in a separate pass means every block has been pushed
+// out of the device's cache by the time it is read.
+FakeType f3_probe_full_surface(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                               const F3Seed *seed, F3Result *result) {
+    f3_result_init(result);
+    size_t chunk_size = tune->io_size * tune->queue_depth;
+    if (chunk_size < FULL_CHUNK_SIZE) {
+        chunk_size = FULL_CHUNK_SIZE;
+    }
+    chunk_size = (size_t)iotune_align_up(tune, chunk_size);
+    
+    BufPool pool;
+    chunk_size = f3_pool_create(&pool, chunk_size, 2, tune);
+    if (chunk_size == 0) {
+        return FAKE_TYPE_DAMAGED;
+    }
+    unsigned char *expected = bufpool_acquire(&pool);
+    unsigned char *actual = bufpool_acquire(&pool);
+    
+    // Only whole sectors can be addressed
+    uint64_t surface = drive_size - drive_size % tune->logical_sector;
+    ExtMap *map = &result->map;
+    Progress progress;
+    
+    printf("Testing full surface (%.2f GB) in %lu KB chunks...\n",
+           (double)surface / (1024 * 1024 * 1024), (unsigned long)(chunk_size / 1024));
+    
+    // Pass 1: write
+    progress_start(&progress, "Writing", surface, NULL, 0, "write errors");
+    for (uint64_t pos = 0; pos < surface; pos += chunk_size) {
+        uint64_t len = surface - pos < chunk_size ? surface - pos : chunk_size;
+        
+        f3_fill_pattern(expected, (size_t)len, pos, seed);
+        uint64_t done = iotune_transfer(hDevice, pos, expected, len, 1, tune);
+        if (done != len) {
+            extmap_set(&result->write_map, pos + done, pos + len, EXT_WRITE_FAILED);
+            result->write_errors++;
+            progress_error(&progress);
         }
+        progress_add(&progress, len, 0);
+    }
+    FlushFileBuffers(hDevice);
+    progress_stop(&progress);
+    
+    // Pass 2: read back and compare sector by sector
+    progress_start(&progress, "Verifying", surface, NULL, 0, "bad chunks");
+    for (uint64_t pos = 0; pos < surface; pos += chunk_size) {
+        uint64_t len = surface - pos < chunk_size ? surface - pos : chunk_size;
+        
+        f3_fill_pattern(expected, (size_t)len, pos, seed);
         
-        // Set file pointer again for reading
-        li.QuadPart = pos;
-        if (!SetFilePointerEx(hDevice, li, NULL, FILE_BEGIN)) {
-            printf("Error setting file pointer for reading at position %llu\n", pos);
-            error_count++;
-            pos += step;
-            continue;
+        // On a read error, mark the failing request and resume after it
+        uint64_t off = 0, bad = 0;
+        while (off < len) {
+            uint64_t done = iotune_transfer(hDevice, pos + off, actual + off, len - off, 0, tune);
+            
+            bad += f3_result_verify(result, pos + off, expected + off, actual + off,
+                                    (size_t)done, tune->logical_sector, seed);
+            off += done;
+            
+            if (off < len) {
+                uint64_t skip = len - off < tune->io_size ? len - off : tune->io_size;
+                extmap_set(map, pos + off, pos + off + skip, EXT_UNREADABLE);
+                bad += skip;
+                off += skip;
+            }
         }
         
-        // Read data
-        QueryPerformanceCounter(&start);
+        if (bad > 0) {
+            progress_error(&progress);
+        }
+        progress_add(&progress, len, 0);
+    }
+    progress_stop(&progress);
+    printf("\n");
+    
+    f3_pool_destroy(&pool);
+    
+    result->tested = surface;
+    return f3_judge_surface(result);
+}
+
+// Probe within a time budget. Each batch saves the blocks it is about to
+// overwrite, writes all patterns before reading any back, and restores the
+// original data afterwards. Stops once the verdict is confident enough.
+FakeType f3_probe_quick(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                        double budget, double threshold, const F3Seed *seed,
+                        F3Result *result) {
+    f3_result_init(result);
+    size_t block_size = (size_t)iotune_align_up(tune, QUICK_BLOCK_SIZE);
+    
+    // One backup per block of the largest batch, plus the pattern and read buffers
+    BufPool pool;
+    block_size = f3_pool_create(&pool, block_size, QUICK_MAX_BATCH + 2, tune);
+    if (block_size == 0) {
+        return FAKE_TYPE_DAMAGED;
+    }
+    uint64_t *points = (uint64_t *)malloc(QUICK_MAX_POINTS * sizeof(uint64_t));
+    char *results = (char *)calloc(QUICK_MAX_POINTS, 1);  // 1 good, 2 bad
+    unsigned char *expected = bufpool_acquire(&pool);
+    unsigned char *actual = bufpool_acquire(&pool);
+    
+    if (!points || !results) {
+        printf("Error: Out of memory\n");
+        free(points);
+        free(results);
+        f3_pool_destroy(&pool);
+        return FAKE_TYPE_DAMAGED;
+    }
+    
+    // Every block must lie within what the handle addresses: on a volume
+    // that is its partition, and writing past it fails rather than aliases
+    int point_count = quickplan_points(points, drive_size, block_size, tune->physical_sector);
+    for (int i = 0; i < point_count; i++) {
+        if (points[i] + block_size > drive_size) {
+            point_count = 0;
+            break;
+        }
+    }
+    if (point_count == 0) {
+        printf("Error: Drive too small for a quick probe\n");
+        free(points);
+        free(results);
+        f3_pool_destroy(&pool);
+        return FAKE_TYPE_DAMAGED;
+    }
+    ExtMap *map = &result->map;
+    
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    
+    printf("Quick probe: up to %.0f seconds, stopping at %.0f%% confidence\n",
+           budget, threshold * 100);
+    
+    int next = 0, batch = 4;
+    int good = 0, bad = 0;
+    uint64_t highest_good_end = 0, lowest_bad = UINT64_MAX;
+    double elapsed = 0, confidence = 0;
+    FakeType verdict = FAKE_TYPE_GOOD;
+    int shown = -1;  // Verdict last reported, -1 before the first batch
+    unsigned char *saved[QUICK_MAX_BATCH];  // Original data, NULL if unreadable
+    
+    // The budget, not the point count, bounds the run, so no total is given
+    Progress progress;
+    progress_start(&progress, "Probing", 0, "points", 0, "bad");
+    
+    while (next < point_count) {
+        // Only start as many points as the remaining budget allows
+        if (next > 0 && elapsed > 0) {
+            int fit = (int)((budget - elapsed) / (elapsed / next));
+            if (fit < batch) {
+                batch = fit;
+            }
+        }
+        if (batch > point_count - next) {
+            batch = point_count - next;
+        }
+        if (batch < 1) {
+            break;
+        }
         
-        if (!ReadFile(hDevice, read_buffer, BLOCK_SIZE, &bytesRead, NULL) || 
-            bytesRead != BLOCK_SIZE) {
-            printf("Error reading at position %llu\n", pos);
-            error_count++;
-            pos += step;
-            continue;
+        // Save, then overwrite every block of the batch
+        for (int i = 0; i < batch; i++) {
+            uint64_t pos = points[next + i];
+            
+            saved[i] = bufpool_acquire(&pool);
+            if (iotune_transfer(hDevice, pos, saved[i], block_size, 0, tune) != block_size) {
+                bufpool_release(&pool, saved[i]);
+                saved[i] = NULL;
+                extmap_set(map, pos, pos + block_size, EXT_UNREADABLE);
+                results[next + i] = 2;
+                continue;
+            }
+            f3_fill_pattern(expected, block_size, pos, seed);
+            if (iotune_transfer(hDevice, pos, expected, block_size, 1, tune) != block_size) {
+                extmap_set(map, pos, pos + block_size, EXT_WRITE_FAILED);
+                results[next + i] = 2;
+            }
         }
+        FlushFileBuffers(hDevice);
         
-        QueryPerformanceCounter(&end);
-        read_seconds += (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+        // Read back and compare
+        for (int i = 0; i < batch; i++) {
+            uint64_t pos = points[next + i];
+            if (results[next + i] != 0) {
+                continue;
+            }
+            f3_fill_pattern(expected, block_size, pos, seed);
+            if (iotune_transfer(hDevice, pos, actual, block_size, 0, tune) != block_size) {
+                extmap_set(map, pos, pos + block_size, EXT_UNREADABLE);
+                results[next + i] = 2;
+                continue;
+            }
+            results[next + i] = f3_verify_block(map, pos, expected, actual, block_size,
+                                                tune->logical_sector, seed) == 0 ? 1 : 2;
+        }
         
-        if (destructive) {
-            // Compare data
-            int mismatch = 0;
-            for (size_t i = 0; i < BLOCK_SIZE; i++) {
-                if (write_buffer[i] != read_buffer[i]) {
-                    mismatch = 1;
-                    break;
-                }
+        // Restore in reverse order, so blocks that alias each other on a
+        // wraparound fake end up holding their original data
+        for (int i = batch - 1; i >= 0; i--) {
+            uint64_t pos = points[next + i];
+            if (saved[i] &&
+                iotune_transfer(hDevice, pos, saved[i], block_size, 1, tune) != block_size) {
+                result->restore_failures++;
             }
-            
-            if (mismatch) {
-                mismatch_count++;
-                if (first_mismatch_pos == 0) {
-                    first_mismatch_pos = pos;
-                }
-                printf("X");  // Indicates mismatch
+            bufpool_release(&pool, saved[i]);
+        }
+        FlushFileBuffers(hDevice);
+        
+        for (int i = 0; i < batch; i++) {
+            uint64_t pos = points[next + i];
+            if (results[next + i] == 1) {
+                good++;
+                if (pos + block_size > highest_good_end) highest_good_end = pos + block_size;
             } else {
-                printf(".");  // Indicates match
+                bad++;
+                if (pos < lowest_bad) lowest_bad = pos;
+                progress_error(&progress);
             }
-        } else {
-            printf(".");  // Just to show progress
+            progress_add(&progress, block_size, 1);
         }
+        next += batch;
         
-        test_count++;
-        if (test_count % 32 == 0) {
-            printf(" %llu MB\n", pos / (1024 * 1024));
+        // Without failures, confidence grows with how close to the end the
+        // drive was proven good and with how much scattered damage the
+        // samples rule out. Each failure makes a bad verdict likelier.
+        if (bad == 0) {
+            verdict = FAKE_TYPE_GOOD;
+            confidence = ((double)highest_good_end / drive_size) *
+                         (1.0 - pow(1.0 - QUICK_BAD_FRACTION, good));
+        } else {
+            verdict = highest_good_end <= lowest_bad ? FAKE_TYPE_POSSIBLY_FAKE : FAKE_TYPE_DAMAGED;
+            confidence = 1.0 - pow(0.1, bad);
         }
         
-        pos += step;
+        QueryPerformanceCounter(&now);
+        elapsed = (double)(now.QuadPart - start.QuadPart) / frequency.QuadPart;
+        if ((int)verdict != shown) {
+            progress_note(&progress, "%d points in %.1fs: %s so far\n", next, elapsed,
+                          verdict == FAKE_TYPE_GOOD ? "genuine" :
+                          verdict == FAKE_TYPE_POSSIBLY_FAKE ? "counterfeit" : "damaged");
+            shown = verdict;
+        }
         
-        // If we've found several mismatches, we can conclude it's fake
-        if (mismatch_count >= 3) {
+        if (confidence >= threshold) {
             break;
         }
+        if (batch * 2 <= QUICK_MAX_BATCH) {
+            batch *= 2;
+        }
     }
+    progress_stop(&progress);
+    printf("\n");
     
-    printf("\n\nTest complete. %d points tested.\n", test_count);
-    
-    if (time_ops) {
-        printf("Write time: %.2f seconds\n", write_seconds);
-        printf("Read time: %.2f seconds\n", read_seconds);
-        printf("Average write speed: %.2f MB/s\n", 
-               (BLOCK_SIZE * test_count) / (write_seconds * 1024 * 1024));
-        printf("Average read speed: %.2f MB/s\n", 
-               (BLOCK_SIZE * test_count) / (read_seconds * 1024 * 1024));
+    result->tested = drive_size;
+    result->usable_size = extmap_safe_size(map, drive_size, 1024 * 1024);
+    result->verdict = verdict;
+    result->confidence = confidence;
+    if (confidence < threshold) {
+        result->note = "time budget ran out";
     }
-    
-    free(write_buffer);
-    free(read_buffer);
-    
-    if (error_count > test_count / 2) {
-        printf("Drive appears to be DAMAGED (too many I/O errors)\n");
-        return FAKE_TYPE_DAMAGED;
-    } else if (mismatch_count > 0) {
-        printf("Drive appears to be COUNTERFEIT\n");
-        printf("First mismatch at: %llu MB\n", first_mismatch_pos / (1024 * 1024));
-        printf("Estimated real capacity: approximately %llu MB\n", 
-               first_mismatch_pos / (1024 * 1024));
-        return FAKE_TYPE_POSSIBLY_FAKE;
-    } else {
-        printf("Drive appears to be GENUINE\n");
-        return FAKE_TYPE_GOOD;
+    if (verdict == FAKE_TYPE_POSSIBLY_FAKE) {
+        // Real capacity lies between the last good block and the first bad one
+        uint64_t good_below = 0;
+        for (int i = 0; i < next; i++) {
+            if (results[i] == 1 && points[i] < lowest_bad && points[i] + block_size > good_below) {
+                good_below = points[i] + block_size;
+            }
+        }
+        result->capacity_low = good_below;
+        result->capacity_high = lowest_bad;
     }
+    
+    free(points);
+    free(results);
+    f3_pool_destroy(&pool);
+    return verdict;
 }
 
-void print_usage(const char* program_name) {
-    printf("F3 Probe for Windows %s - probe a flash drive for counterfeit\n", VERSION);
-    printf("Copyright (C) 2010 Digirati Internet LTDA.\n");
-    printf("This is free software; see the source for copying conditions.\n\n");
+static void print_usage(const char* program_name) {
+    f3_print_header("F3 Probe for Windows - probe a flash drive for counterfeit");
     
     printf("Usage: %s [options] drive_letter:\n", program_name);
     printf("Options:\n");
     printf("  --destructive       Perform destructive testing (will overwrite data)\n");
+    printf("  --full-surface      Write and verify every sector (implies --destructive)\n");
+    printf("  --quick[=SECONDS]   Timed probe that restores the blocks it overwrites\n");
+    printf("                      (default 10 seconds)\n");
+    printf("  --confidence=PCT    Stop the quick probe at this confidence (default 95)\n");
     printf("  --time-ops          Time read and write operations\n");
+    printf("  --save-map FILE     Save the map of good and bad ranges to FILE\n");
+    printf("  --no-tune           Skip I/O size calibration and use 1MB requests\n");
+    f3_print_mem_limit_usage(20);
     printf("  --help              Display this help text\n");
     printf("\nExample: %s --destructive J:\n", program_name);
     printf("\nWARNING: Destructive mode will overwrite data on the drive.\n");
     printf("         Please backup your data before using this option.\n");
 }
 
-int main(int argc, char **argv) {
+int f3_probe_main(int argc, char **argv) {
     int destructive = 0;
     int time_ops = 0;
+    int no_tune = 0;
+    int full_surface = 0;
+    double quick_budget = 0;  // Seconds; 0 means no quick probe
+    double confidence = 0.95;
+    const char *map_file = NULL;
     char drive_letter = 0;
     
     // Parse command line args
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--destructive") == 0) {
             destructive = 1;
+        } else if (strcmp(argv[i], "--full-surface") == 0) {
+            full_surface = 1;
+            destructive = 1;
+        } else if (strncmp(argv[i], "--quick", 7) == 0 &&
+                   (argv[i][7] == '\0' || argv[i][7] == '=')) {
+            quick_budget = argv[i][7] == '=' ? atof(argv[i] + 8) : 10;
+            if (quick_budget <= 0) {
+                printf("Error: Invalid time budget: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--confidence=", 13) == 0) {
+            confidence = atof(argv[i] + 13) / 100;
+            if (confidence <= 0 || confidence >= 1) {
+                printf("Error: Confidence must be between 0 and 100: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--save-map") == 0 && i + 1 < argc) {
+            map_file = argv[++i];
         } else if (strcmp(argv[i], "--time-ops") == 0) {
             time_ops = 1;
+        } else if (strncmp(argv[i], "--mem-limit=", 12) == 0) {
+            if (!f3_parse_mem_limit(argv[i] + 12)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--no-tune") == 0) {
+            no_tune = 1;
         } else if (strcmp(argv[i], "--help") == 0) {
             print_usage(argv[0]);
             return 0;
@@ -268,26 +532,12 @@ int main(int argc, char **argv) {
         return 1;
     }
     
-    // Construct physical drive path
-    char physical_drive_path[128];
-    sprintf(physical_drive_path, "\\\\.\\%c:", drive_letter);
-    
-    printf("F3 Probe for Windows %s\n", VERSION);
-    printf("Copyright (C) 2010 Digirati Internet LTDA.\n");
-    printf("This is free software; see the source for copying conditions.\n\n");
+    f3_print_header("F3 Probe for Windows");
     
     printf("Probing drive %c:\n", drive_letter);
     
     // Open the drive
-    HANDLE hDevice = CreateFile(
-        physical_drive_path,
-        GENERIC_READ | (destructive ? GENERIC_WRITE : 0),
-        FILE_SHARE_READ | FILE_SHARE_WRITE,
-        NULL,
-        OPEN_EXISTING,
-        FILE_FLAG_NO_BUFFERING | FILE_FLAG_RANDOM_ACCESS,
-        NULL
-    );
+    HANDLE hDevice = f3_open_drive(drive_letter, destructive || quick_budget > 0);
     
     if (hDevice == INVALID_HANDLE_VALUE) {
         DWORD error = GetLastError();
@@ -297,17 +547,50 @@ int main(int argc, char **argv) {
         return 1;
     }
     
-    uint64_t drive_size = get_drive_size(hDevice);
+    uint64_t drive_size = f3_get_drive_size(hDevice);
     if (drive_size == 0) {
         printf("Error: Could not determine drive size\n");
         CloseHandle(hDevice);
         return 1;
     }
     
-    FakeType result = test_drive(hDevice, drive_size, destructive, time_ops);
+    // Use the device's real sector size and the request shape it handles best
+    IoTune tune;
+    iotune_defaults(&tune);
+    // Calibrate with reads only so the drive's contents are never touched.
+    // Skipped for the quick probe: calibration would eat most of its budget,
+    // and it uses 1MB blocks anyway.
+    f3_tune_drive(hDevice, drive_size, !no_tune && quick_budget == 0, &tune);
+    iotune_print(&tune);
+    printf("\n");
+    
+    // A fresh pattern every run; it is only needed until the run is over
+    F3Seed seed;
+    f3_seed_generate(&seed);
+
+    F3Result result;
+    if (full_surface) {
+        if (!f3_lock_volume(hDevice)) {
+            printf("Warning: Could not lock drive %c:, writes to areas in use may fail\n\n",
+                   drive_letter);
+        }
+        f3_probe_full_surface(hDevice, drive_size, &tune, &seed, &result);
+    } else if (quick_budget > 0) {
+        if (!f3_lock_volume(hDevice)) {
+            printf("Warning: Could not lock drive %c:, writes to areas in use may fail\n\n",
+                   drive_letter);
+        }
+        f3_probe_quick(hDevice, drive_size, &tune, quick_budget, confidence, &seed, &result);
+    } else {
+        f3_probe_sample(hDevice, drive_size, &tune, destructive, time_ops, &seed, &result);
+    }
     
     // Close the drive
+    iotune_close(&tune);
     CloseHandle(hDevice);
     
-    return result == FAKE_TYPE_GOOD ? 0 : 1;
+    f3_print_result(&result, map_file);
+    int status = result.verdict == FAKE_TYPE_GOOD ? 0 : 1;
+    f3_result_free(&result);
+    return status;
 }
\ No newline at end of file
@@ -5,129 +5,315 @@
 #include <stdint.h>
 #include <windows.h>
 
-#define VERSION "9.0-win"
-#define DEFAULT_BLOCK_SIZE (1 * 1024 * 1024)  // 1MB blocks
-#define MAX_PATH_LENGTH 256
+#include "libf3.h"
+#include "rawlayout.h"
+
 #define MAX_FILES 10000
+#define TUNE_SPAN (256ULL * 1024 * 1024)  // Volume region read during calibration
+#define RAW_CHUNK_SIZE (8 << 20)  // Minimum bytes per raw transfer
 
-// Fixed-size buffer for reading files
+// Fixed-size buffers for reading files and regenerating their contents
 static unsigned char *g_buffer;
+static unsigned char *g_expected;
 static size_t g_buffer_size;
 
 typedef struct {
-    char filename[MAX_PATH_LENGTH];
+    char filename[F3_MAX_PATH_LENGTH];
     uint64_t size;
     int corrupt;
     int missing;
 } FileEntry;
 
-// Format size with appropriate unit
-const char* format_size(double *size) {
-    static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
-    int unit = 0;
-    
-    while (*size >= 1024 && unit < 4) {
-        *size /= 1024;
-        unit++;
+// Find the fastest request shape by reading the raw volume.
+// Opening the volume for reading needs administrator rights; without them
+// only the sector sizes are queried and the defaults are kept.
+static void tune_read(const char *full_path, uint64_t volume_size, int calibrate, IoTune *tune) {
+    HANDLE hVolume = iotune_open_volume(full_path, 0);
+    if (hVolume != INVALID_HANDLE_VALUE) {
+        iotune_query_geometry(hVolume, tune);
+        CloseHandle(hVolume);
     }
     
-    return units[unit];
-}
-
-// Check if the buffer starts with the expected marker
-int check_block_marker(unsigned char *buffer, size_t size, int expected_block) {
-    char expected_marker[64];
-    sprintf(expected_marker, "F3 Block %d", expected_block);
+    if (!calibrate) {
+        return;
+    }
     
-    // If the buffer doesn't start with our marker, it's corrupted
-    if (memcmp(buffer, expected_marker, strlen(expected_marker)) != 0) {
-        return 0;
+    hVolume = iotune_open_volume(full_path, GENERIC_READ);
+    if (hVolume == INVALID_HANDLE_VALUE) {
+        printf("Calibration skipped: run as administrator to tune reads\n");
+        return;
     }
     
-    return 1;
+    uint64_t span = volume_size < TUNE_SPAN ? volume_size : TUNE_SPAN;
+    f3_calibrate(hVolume, 0, span, 0, tune);
+    CloseHandle(hVolume);
 }
 
-// Verify a specific file
-int verify_file(const char *filename, int expected_block, unsigned char *buffer, size_t buffer_size, uint64_t *size) {
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
+// Verify a file against the block f3write generated for it, recording its
+// sectors in the map at the block's position in the written data. Returns 1
+// if good, 0 if corrupted or truncated and -1 if the file could not be
+// opened.
+static int verify_file(const char *filename, int expected_block, uint64_t block_size,
+                       const IoTune *tune, const F3Seed *seed, ExtMap *map, uint64_t *size) {
+    // Bypass the cache so data just written by f3write is read from the device
+    HANDLE hFile = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED |
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
         return -1;  // File missing
     }
     
     // Get file size
-    fseek(f, 0, SEEK_END);
-    *size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    // Read the file in chunks if needed
-    size_t total_read = 0;
-    size_t bytes_read;
-    int status = 1;  // Assume good until proven bad
-    
-    while ((bytes_read = fread(buffer + total_read, 1, buffer_size - total_read, f)) > 0) {
-        total_read += bytes_read;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(hFile, &file_size)) {
+        CloseHandle(hFile);
+        return -1;
+    }
+    *size = file_size.QuadPart;
+    
+    // Every file holds one block at a fixed stride. A file of another size
+    // was cut short or altered: what it holds is still compared at its own
+    // offsets, and the rest of the block counts as unreadable.
+    uint64_t data_pos = (uint64_t)expected_block * block_size;
+    uint64_t limit = *size < block_size ? *size : block_size;
+    int good = *size == block_size;
+    
+    // Files larger than the buffers are read a buffer at a time
+    uint64_t off = 0;
+    while (off < limit) {
+        uint64_t len = limit - off < g_buffer_size ? limit - off : g_buffer_size;
         
-        if (total_read >= buffer_size) {
+        // Unbuffered reads must cover whole sectors; the last one comes back short
+        uint64_t done = iotune_transfer(hFile, off, g_buffer, iotune_align_up(tune, len), 0, tune);
+        if (done > len) {
+            done = len;
+        }
+        
+        f3_fill_pattern(g_expected, (size_t)done, data_pos + off, seed);
+        if (f3_verify_block(map, data_pos + off, g_expected, g_buffer, (size_t)done,
+                            tune->logical_sector, seed) != 0) {
+            good = 0;
+        }
+        off += done;
+        
+        // If we didn't read the whole file, it's corrupted
+        if (done < len) {
+            good = 0;
             break;
         }
     }
+    extmap_set(map, data_pos + off, data_pos + block_size, EXT_UNREADABLE);
     
-    fclose(f);
-    
-    // If we didn't read the whole file, it's corrupted
-    if (total_read != *size) {
-        return 0;  // Corrupted
+    CloseHandle(hFile);
+    return good;
+}
+
+// Stream back what f3write --raw wrote, as described by its header
+static int read_raw(const char *target, const char *map_file, int no_tune) {
+    int is_drive;
+    HANDLE hDevice = f3_open_raw(target, 0, &is_drive);
+    if (hDevice == INVALID_HANDLE_VALUE) {
+        printf("Error opening %s (code %lu)\n", target, GetLastError());
+        if (is_drive) {
+            printf("Make sure you run this program with administrator privileges\n");
+        }
+        return 1;
     }
-    
-    // Verify file contents
-    if (!check_block_marker(buffer, total_read, expected_block)) {
-        return 0;  // Corrupted
+
+    IoTune tune;
+    iotune_defaults(&tune);
+    uint64_t device_size = f3_get_drive_size(hDevice);
+    f3_tune_drive(hDevice, device_size, is_drive && !no_tune, &tune);
+    iotune_print(&tune);
+    printf("\n");
+
+    size_t chunk_size = tune.io_size * tune.queue_depth;
+    if (chunk_size < RAW_CHUNK_SIZE) {
+        chunk_size = RAW_CHUNK_SIZE;
     }
-    
-    // To fully verify, we would need to regenerate the pseudo-random data and compare,
-    // but for simplicity, we just check the marker
-    
-    return 1;  // Good
+    chunk_size = (size_t)iotune_align_up(&tune, chunk_size);
+    BufPool pool;
+    chunk_size = f3_pool_create(&pool, chunk_size, 2, &tune);
+    if (chunk_size == 0) {
+        iotune_close(&tune);
+        CloseHandle(hDevice);
+        return 1;
+    }
+    g_buffer = bufpool_acquire(&pool);
+    g_expected = bufpool_acquire(&pool);
+
+    RawLayout layout;
+    size_t header_size = (size_t)iotune_align_up(&tune, RAWLAYOUT_HEADER_SIZE);
+    if (iotune_transfer(hDevice, 0, g_buffer, header_size, 0, &tune) != header_size ||
+        !rawlayout_decode(&layout, g_buffer)) {
+        printf("No F3 raw layout found on %s\n", target);
+        printf("Run f3write --raw first to write one.\n");
+        f3_pool_destroy(&pool);
+        iotune_close(&tune);
+        CloseHandle(hDevice);
+        return 1;
+    }
+    // Layouts from before volumes were sized by their partition can
+    // claim more than the volume holds; only what fits can be checked
+    if (is_drive && !rawlayout_fits(&layout, device_size)) {
+        uint64_t room = device_size > layout.data_offset ? device_size - layout.data_offset : 0;
+        printf("Warning: Layout extends past the end of %s\n", target);
+        if (layout.written > room) {
+            layout.written = room - room % tune.physical_sector;
+        }
+    }
+    if (!layout.complete) {
+        printf("Warning: Writing did not finish, checking the %llu MB written\n",
+               (unsigned long long)(layout.written / (1024 * 1024)));
+    }
+    printf("Verifying %.2f MB at offset %llu...\n", layout.written / (1024.0 * 1024.0),
+           (unsigned long long)layout.data_offset);
+    F3Seed seed = {layout.seed_lo, layout.seed_hi};
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    // Positions in the map are relative to the data region
+    ExtMap map;
+    extmap_init(&map, EXTMAP_DEFAULT_MAX_RUNS);
+    Progress progress;
+    progress_start(&progress, "Verifying", layout.written, NULL, 0, "bad chunks");
+    for (uint64_t pos = 0; pos < layout.written; pos += chunk_size) {
+        uint64_t len = layout.written - pos < chunk_size ? layout.written - pos : chunk_size;
+
+        f3_fill_pattern(g_expected, (size_t)len, pos, &seed);
+
+        // On a read error, mark the failing request and resume after it
+        uint64_t off = 0, bad = 0;
+        while (off < len) {
+            uint64_t done = iotune_transfer(hDevice, layout.data_offset + pos + off,
+                                            g_buffer + off, len - off, 0, &tune);
+            bad += f3_verify_block(&map, pos + off, g_expected + off, g_buffer + off,
+                                   (size_t)done, tune.logical_sector, &seed);
+            off += done;
+
+            if (off < len) {
+                uint64_t skip = len - off < tune.io_size ? len - off : tune.io_size;
+                extmap_set(&map, pos + off, pos + off + skip, EXT_UNREADABLE);
+                bad += skip;
+                off += skip;
+            }
+        }
+
+        if (bad > 0) {
+            progress_error(&progress);
+        }
+        progress_add(&progress, len, 0);
+    }
+    progress_stop(&progress);
+    QueryPerformanceCounter(&end);
+
+    double elapsed = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    double total_mb = layout.written / (1024.0 * 1024.0);
+    printf("\nVerified %.2f MB in %.1f seconds, %.2f MB/s\n",
+           total_mb, elapsed, elapsed > 0 ? total_mb / elapsed : 0);
+
+    uint64_t good_bytes = extmap_bytes(&map, EXT_GOOD);
+    printf("Data integrity: %.2f%% (%.2f MB of %.2f MB)\n",
+           layout.written > 0 ? 100.0 * good_bytes / layout.written : 100.0,
+           good_bytes / (1024.0 * 1024.0), total_mb);
+
+    int bad = extmap_first_bad(&map) != UINT64_MAX;
+    if (bad) {
+        printf("\nBad ranges by position in the written data:\n");
+        extmap_print(&map, stdout, 1);
+        printf("First %llu MB of written data is intact\n",
+               (unsigned long long)(extmap_safe_size(&map, layout.written, 1024 * 1024) /
+                                    (1024 * 1024)));
+    }
+    if (map_file) {
+        if (extmap_save(&map, map_file)) {
+            printf("Map saved to %s\n", map_file);
+        } else {
+            printf("Error: Could not save map to %s\n", map_file);
+        }
+    }
+    extmap_free(&map);
+
+    if (bad) {
+        printf("\nWARNING: %.2f MB of the written data did not read back intact!\n",
+               (layout.written - good_bytes) / (1024.0 * 1024.0));
+        printf("This suggests your flash drive may be counterfeit or damaged.\n");
+    } else {
+        printf("\nGood news: All written data read back intact!\n");
+        printf("The flash drive appears to be genuine.\n");
+    }
+
+    f3_pool_destroy(&pool);
+    iotune_close(&tune);
+    CloseHandle(hDevice);
+    return bad || !layout.complete ? 1 : 0;
 }
 
 // Read files to test flash memory
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        printf("Usage: f3read.exe <PATH>\n");
+int f3_read_main(int argc, char **argv) {
+    // Parse arguments
+    char *path = NULL;
+    const char *map_file = NULL;
+    int no_tune = 0;
+    int raw = 0;
+    const char *seed_arg = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-tune") == 0) {
+            no_tune = 1;
+        } else if (strncmp(argv[i], "--mem-limit=", 12) == 0) {
+            if (!f3_parse_mem_limit(argv[i] + 12)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            raw = 1;
+        } else if (strcmp(argv[i], "--save-map") == 0 && i + 1 < argc) {
+            map_file = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed_arg = argv[++i];
+        } else if (!path) {
+            path = argv[i];
+        }
+    }
+    
+    if (!path) {
+        printf("Usage: f3read.exe [--no-tune] [--raw] [--save-map FILE] [--seed HEX] "
+               "[--mem-limit=MB] <PATH>\n");
         printf("F3 Read - Test flash memory card for counterfeit\n");
         printf("Example: f3read.exe E:\\\n");
+        printf("  --no-tune        Skip I/O size calibration and use 1MB requests\n");
+        printf("  --save-map FILE  Save the map of good and bad ranges to FILE\n");
+        printf("  --raw            Verify what f3write --raw wrote to a volume (E:)\n");
+        printf("                   or an image file\n");
+        printf("  --seed HEX       Session seed f3write printed, if %s was lost\n",
+               F3_SEED_FILE);
+        f3_print_mem_limit_usage(17);
         return 1;
     }
 
-    // Parse arguments
-    char *path = argv[1];
-
-    // Print header
-    printf("F3 Read - Test flash memory card for counterfeit v%s\n", VERSION);
-    printf("Copyright (C) 2010 Digirati Internet LTDA.\n");
-    printf("This is free software; see the source for copying conditions.\n\n");
+    f3_print_header("F3 Read - Test flash memory card for counterfeit");
 
-    // Check if the path exists and is a directory
-    DWORD attr = GetFileAttributes(path);
-    if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
-        printf("Error: %s is not a valid directory\n", path);
+    // Parsed before anything is read, so a typo does not cost a whole pass
+    F3Seed seed;
+    if (seed_arg && (strlen(seed_arg) != F3_SEED_TEXT_LENGTH || !f3_seed_parse(&seed, seed_arg))) {
+        printf("Error: Invalid seed: %s\n", seed_arg);
+        printf("Give the %d hex digits f3write printed as the session seed.\n",
+               F3_SEED_TEXT_LENGTH);
         return 1;
     }
 
-    // Make sure path ends with backslash
-    char full_path[MAX_PATH_LENGTH];
-    strncpy(full_path, path, MAX_PATH_LENGTH - 1);
-    full_path[MAX_PATH_LENGTH - 1] = '\0';
-    
-    size_t len = strlen(full_path);
-    if (len > 0 && full_path[len - 1] != '\\' && full_path[len - 1] != '/') {
-        if (len < MAX_PATH_LENGTH - 1) {
-            full_path[len] = '\\';
-            full_path[len + 1] = '\0';
-        } else {
-            printf("Error: Path too long\n");
-            return 1;
+    if (raw) {
+        if (seed_arg) {
+            printf("Note: --seed is ignored with --raw, the header holds the seed\n");
         }
+        return read_raw(path, map_file, no_tune);
+    }
+
+    char full_path[F3_MAX_PATH_LENGTH];
+    if (!f3_normalize_dir(path, full_path, sizeof(full_path))) {
+        return 1;
     }
 
     // Collect all F3 test files
@@ -136,7 +322,7 @@ int main(int argc, char **argv) {
     int max_block_num = -1;
     
     // Construct search pattern
-    char search_pattern[MAX_PATH_LENGTH];
+    char search_pattern[F3_MAX_PATH_LENGTH];
     sprintf(search_pattern, "%sF3_*.txt", full_path);
     
     // Search for files
@@ -179,16 +365,54 @@ int main(int argc, char **argv) {
         return 1;
     }
     
-    printf("Found %d F3 test files. Verifying...\n", file_count);
+    printf("Found %d F3 test files.\n", file_count);
+
+    // The data is regenerated from the seed f3write stored with it, unless
+    // it was given on the command line
+    uint64_t block_size = 0;
+    if (!seed_arg && !f3_seed_load(full_path, &seed, &block_size)) {
+        printf("Error: %s%s is missing or damaged\n", full_path, F3_SEED_FILE);
+        printf("Give the session seed f3write printed with --seed, or run f3write again.\n");
+        return 1;
+    }
     
-    // Allocate buffer for reading
-    g_buffer_size = DEFAULT_BLOCK_SIZE;
-    g_buffer = (unsigned char *)malloc(g_buffer_size);
-    if (!g_buffer) {
-        printf("Error: Out of memory\n");
+    // Without a recorded block size, take the biggest file: f3write makes
+    // all files the same size and deletes one it could not finish
+    if (block_size == 0) {
+        for (int j = 0; j < file_count; j++) {
+            if (files[j].size > block_size) {
+                block_size = files[j].size;
+            }
+        }
+    }
+    if (block_size == 0) {
+        printf("Error: All test files are empty\n");
         return 1;
     }
     
+    // Pick the request size and queue depth this volume handles best
+    IoTune tune;
+    iotune_defaults(&tune);
+    ULARGE_INTEGER free_bytes_available, volume_bytes, total_free_bytes;
+    if (!GetDiskFreeSpaceEx(full_path, &free_bytes_available, &volume_bytes, &total_free_bytes)) {
+        volume_bytes.QuadPart = 0;
+    }
+    tune_read(full_path, volume_bytes.QuadPart, !no_tune, &tune);
+    iotune_print(&tune);
+    printf("\nVerifying...\n");
+    
+    // Buffers hold a whole block unless the memory limit is lower, in
+    // which case files are verified piece by piece
+    g_buffer_size = (size_t)iotune_align_up(&tune, block_size);
+    BufPool pool;
+    g_buffer_size = f3_pool_create(&pool, g_buffer_size, 2, &tune);
+    if (g_buffer_size == 0) {
+        iotune_close(&tune);
+        return 1;
+    }
+    g_buffer = bufpool_acquire(&pool);
+    g_expected = bufpool_acquire(&pool);
+    
     // Start verification
     time_t start_time = time(NULL);
     uint64_t total_bytes = 0;
@@ -198,9 +422,19 @@ int main(int argc, char **argv) {
     int corrupt_files = 0;
     int missing_files = 0;
     
-    // Progress reporting
-    int progress_percent = 0;
-    int prev_progress = -1;
+    // Results by position in write order: block i starts at i * block_size
+    ExtMap map;
+    extmap_init(&map, EXTMAP_DEFAULT_MAX_RUNS);
+    uint64_t data_end = ((uint64_t)max_block_num + 1) * block_size;
+    
+    // Progress is drawn by a reporter thread from these counters
+    uint64_t bytes_to_read = 0;
+    for (int j = 0; j < file_count; j++) {
+        bytes_to_read += files[j].size;
+    }
+    Progress progress;
+    progress_start(&progress, "Verifying", bytes_to_read,
+                   "files", (uint64_t)max_block_num + 1, "corrupted");
     
     for (int i = 0; i <= max_block_num; i++) {
         // Find the file with this block number
@@ -221,10 +455,18 @@ int main(int argc, char **argv) {
             }
         }
         
+        uint64_t data_pos = (uint64_t)i * block_size;
         if (found) {
             // Verify this file
-            uint64_t file_size;
-            int result = verify_file(files[file_idx].filename, i, g_buffer, g_buffer_size, &file_size);
+            uint64_t file_size = 0;
+            int result = verify_file(files[file_idx].filename, i, block_size, &tune, &seed,
+                                     &map, &file_size);
+            if (result < 0) {
+                extmap_set(&map, data_pos, data_pos + block_size, EXT_UNREADABLE);
+            } else if (file_size < block_size) {
+                // Truncated: the rest of the block is as good as missing
+                missing_bytes += block_size - file_size;
+            }
             
             if (result == 1) {
                 // File is good
@@ -232,6 +474,7 @@ int main(int argc, char **argv) {
                 total_bytes += file_size;
             } else if (result == 0) {
                 // File is corrupted
+                progress_error(&progress);
                 corrupt_files++;
                 corrupted_bytes += file_size;
                 total_bytes += file_size;
@@ -245,21 +488,14 @@ int main(int argc, char **argv) {
         } else {
             // File for this block is missing
             missing_files++;
-            // We don't know the size of missing files, so we use block size as estimate
-            missing_bytes += g_buffer_size;
+            missing_bytes += block_size;
+            extmap_set(&map, data_pos, data_pos + block_size, EXT_UNREADABLE);
         }
         
-        // Update progress
-        progress_percent = (int)(((i + 1) * 100) / (max_block_num + 1));
-        if (progress_percent != prev_progress) {
-            printf("\rProgress: %d%% (%d/%d files, %d corrupted)", 
-                  progress_percent, i + 1, max_block_num + 1, corrupt_files);
-            fflush(stdout);
-            prev_progress = progress_percent;
-        }
+        progress_add(&progress, found ? files[file_idx].size : 0, 1);
     }
     
-    printf("\rProgress: 100%% (%d files, %d corrupted)    \n", file_count, corrupt_files);
+    progress_stop(&progress);
     
     // Print summary
     time_t end_time = time(NULL);
@@ -285,6 +521,22 @@ int main(int argc, char **argv) {
            good_percent, (total_bytes - corrupted_bytes) / (1024.0 * 1024.0), 
            (total_bytes + missing_bytes) / (1024.0 * 1024.0));
     
+    // Where the problems are, in write order (missing files count as unreadable)
+    if (extmap_first_bad(&map) != UINT64_MAX) {
+        printf("\nBad ranges by position in the written data:\n");
+        extmap_print(&map, stdout, 1);
+        printf("First %llu MB of written data is intact\n",
+               (unsigned long long)(extmap_safe_size(&map, data_end, 1024 * 1024) / (1024 * 1024)));
+    }
+    if (map_file) {
+        if (extmap_save(&map, map_file)) {
+            printf("Map saved to %s\n", map_file);
+        } else {
+            printf("Error: Could not save map to %s\n", map_file);
+        }
+    }
+    extmap_free(&map);
+    
     if (corrupt_files > 0 || missing_files > 0) {
         printf("\nWARNING: Detected %d corrupted files and %d missing files!\n", 
                corrupt_files, missing_files);
@@ -295,7 +547,8 @@ int main(int argc, char **argv) {
     }
     
     // Clean up
-    free(g_buffer);
+    f3_pool_destroy(&pool);
+    iotune_close(&tune);
     
     return (corrupt_files > 0 || missing_files > 0) ? 1 : 0;
 }
\ No newline at end of file
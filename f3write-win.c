@@ -5,92 +5,428 @@
 #include <stdint.h>
 #include <windows.h>
 
-#define VERSION "9.0-win"
+#include "libf3.h"
+#include "rawlayout.h"
+
 #define DEFAULT_BLOCK_SIZE (1 * 1024 * 1024)  // 1MB blocks
-#define MAX_PATH_LENGTH 256
+#define TUNE_FILE_SIZE (64ULL * 1024 * 1024)  // Scratch file written during calibration
+#define RAW_CHUNK_SIZE (8 << 20)  // Minimum bytes per raw transfer
+#define RAW_HEADER_INTERVAL (1024ULL * 1024 * 1024)  // Header refresh while writing
+
+#define SYNC_MAX_PENDING 64  // Written files kept open for one batched flush
 
 // Fixed-size buffer that is filled with pseudo-random data
 static unsigned char *g_buffer;
 static size_t g_buffer_size;
 
-// Initialize buffer with pseudo-random data and a marker
-void init_buffer(unsigned char *buffer, size_t size, int block_number) {
-    // Use block_number as seed for reproducibility
-    srand(block_number);
-    
-    // Fill most of the buffer with pseudo-random data
-    for (size_t i = 0; i < size; i++) {
-        buffer[i] = rand() % 256;
+// When written data is forced out of the device's cache
+typedef enum {
+    SYNC_NONE,   // Never; the speed may include data still in a cache
+    SYNC_BYTES,  // After every interval bytes
+    SYNC_FILE,   // After every file
+    SYNC_END     // Once, after the last write
+} SyncMode;
+
+typedef struct {
+    SyncMode mode;
+    uint64_t interval;                  // SYNC_BYTES only
+    HANDLE volume;                      // Flushes every file at once, if it could be opened
+    HANDLE pending[SYNC_MAX_PENDING];   // Written files not flushed yet
+    int count;
+    uint64_t bytes;                     // Written since the last flush
+    int batches;                        // Flushes forced early by a full pending list
+    int failures;
+} SyncPolicy;
+
+// Parse "none", "file", "end" or a number of MB
+static int parse_sync(const char *arg, SyncPolicy *sync) {
+    memset(sync, 0, sizeof(*sync));
+    sync->volume = INVALID_HANDLE_VALUE;
+    if (strcmp(arg, "none") == 0) {
+        sync->mode = SYNC_NONE;
+    } else if (strcmp(arg, "file") == 0) {
+        sync->mode = SYNC_FILE;
+    } else if (strcmp(arg, "end") == 0) {
+        sync->mode = SYNC_END;
+    } else {
+        long long mb = atoll(arg);
+        if (mb <= 0) {
+            return 0;
+        }
+        sync->mode = SYNC_BYTES;
+        sync->interval = (uint64_t)mb * 1024 * 1024;
     }
-    
-    // Write a marker at the beginning of the buffer that includes the block number
-    // This allows f3read to verify the block
-    char marker[64];
-    sprintf(marker, "F3 Block %d", block_number);
-    memcpy(buffer, marker, strlen(marker) + 1);
+    return 1;
 }
 
-// Format size with appropriate unit
-const char* format_size(double *size) {
-    static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
-    int unit = 0;
-    
-    while (*size >= 1024 && unit < 4) {
-        *size /= 1024;
-        unit++;
+// Describe what was actually done, which can differ from what was asked:
+// without the volume handle, open files are flushed whenever
+// SYNC_MAX_PENDING of them have piled up
+static const char *describe_sync(const SyncPolicy *sync) {
+    static char text[80];
+    switch (sync->mode) {
+    case SYNC_NONE:
+        return "not flushed";
+    case SYNC_FILE:
+        return "flushed after every file";
+    case SYNC_END:
+        if (sync->batches > 0) {
+            snprintf(text, sizeof(text), "flushed in batches of %d files", SYNC_MAX_PENDING);
+            return text;
+        }
+        return "flushed at the end";
+    default:
+        snprintf(text, sizeof(text), "flushed every %llu MB",
+                 (unsigned long long)(sync->interval / (1024 * 1024)));
+        if (sync->batches > 0) {
+            snprintf(text + strlen(text), sizeof(text) - strlen(text),
+                     " or %d files", SYNC_MAX_PENDING);
+        }
+        return text;
     }
-    
-    return units[unit];
+}
+
+// Flush and close the files written since the last flush
+static void sync_flush(SyncPolicy *sync) {
+    for (int i = 0; i < sync->count; i++) {
+        if (!FlushFileBuffers(sync->pending[i])) {
+            sync->failures++;
+        }
+        CloseHandle(sync->pending[i]);
+    }
+    if (sync->volume != INVALID_HANDLE_VALUE && sync->bytes > 0 &&
+        !FlushFileBuffers(sync->volume)) {
+        sync->failures++;
+    }
+    sync->count = 0;
+    sync->bytes = 0;
+}
+
+// Take over a file that has just been written. Flushing the volume covers
+// all files in one call; without it (no administrator rights) files are
+// kept open and flushed in batches.
+static void sync_file_written(SyncPolicy *sync, HANDLE hFile, uint64_t bytes) {
+    if (sync->mode == SYNC_NONE) {
+        CloseHandle(hFile);
+        return;
+    }
+
+    if (sync->volume != INVALID_HANDLE_VALUE && sync->mode != SYNC_FILE) {
+        CloseHandle(hFile);
+    } else {
+        sync->pending[sync->count++] = hFile;
+    }
+    sync->bytes += bytes;
+
+    if (sync->mode == SYNC_FILE ||
+        (sync->mode == SYNC_BYTES && sync->bytes >= sync->interval)) {
+        sync_flush(sync);
+    } else if (sync->count == SYNC_MAX_PENDING) {
+        sync->batches++;
+        sync_flush(sync);
+    }
+}
+
+// Delete the test files of an earlier run. They would be checked against
+// this run's seed, and any beyond this run's last file would read back as
+// corrupted. Returns the number deleted.
+static int delete_old_files(const char *full_path) {
+    char search_pattern[F3_MAX_PATH_LENGTH];
+    snprintf(search_pattern, sizeof(search_pattern), "%sF3_*.txt", full_path);
+
+    WIN32_FIND_DATA find_data;
+    HANDLE find_handle = FindFirstFile(search_pattern, &find_data);
+    if (find_handle == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    int deleted = 0;
+    do {
+        // F3_seed.txt matches the search too; only numbered files are data
+        int block_num;
+        if (sscanf(find_data.cFileName, "F3_%d.txt", &block_num) != 1) {
+            continue;
+        }
+        char filename[F3_MAX_PATH_LENGTH];
+        snprintf(filename, sizeof(filename), "%s%s", full_path, find_data.cFileName);
+        if (DeleteFile(filename)) {
+            deleted++;
+        } else {
+            printf("Warning: Could not delete %s (code %lu)\n", filename, GetLastError());
+        }
+    } while (FindNextFile(find_handle, &find_data) != 0);
+
+    FindClose(find_handle);
+    return deleted;
+}
+
+// Find the fastest request shape by writing a scratch file on the target volume
+static void tune_write(const char *full_path, uint64_t available_bytes, IoTune *tune) {
+    HANDLE hVolume = iotune_open_volume(full_path, 0);
+    if (hVolume != INVALID_HANDLE_VALUE) {
+        iotune_query_geometry(hVolume, tune);
+        CloseHandle(hVolume);
+    }
+
+    uint64_t span = available_bytes / 4;
+    if (span > TUNE_FILE_SIZE) {
+        span = TUNE_FILE_SIZE;
+    }
+
+    char filename[F3_MAX_PATH_LENGTH];
+    snprintf(filename, sizeof(filename), "%sF3_tune.tmp", full_path);
+    HANDLE hFile = CreateFile(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                              FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED |
+                              FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        printf("Calibration skipped: could not create %s\n", filename);
+        return;
+    }
+
+    f3_calibrate(hFile, 0, span, 1, tune);
+    CloseHandle(hFile);
+}
+
+// Write the header sector(s) at the start of the target
+static int write_raw_header(HANDLE hDevice, const RawLayout *layout, unsigned char *buffer,
+                            size_t header_size, const IoTune *tune) {
+    memset(buffer, 0, header_size);
+    rawlayout_encode(layout, buffer);
+    return iotune_transfer(hDevice, 0, buffer, header_size, 1, tune) == header_size;
+}
+
+// Write the pattern straight to a volume or image file behind a small
+// header, skipping the filesystem. num_mb of 0 fills the whole volume.
+// The device has no files, so SYNC_FILE flushes like SYNC_END.
+static int write_raw(const char *target, int num_mb, int no_tune, SyncPolicy *sync) {
+    int is_drive;
+    HANDLE hDevice = f3_open_raw(target, 1, &is_drive);
+    if (hDevice == INVALID_HANDLE_VALUE) {
+        printf("Error opening %s (code %lu)\n", target, GetLastError());
+        if (is_drive) {
+            printf("Make sure you run this program with administrator privileges\n");
+            printf("and that the drive is not in use by another program.\n");
+        }
+        return 1;
+    }
+
+    uint64_t device_size = f3_get_drive_size(hDevice);
+    IoTune tune;
+    iotune_defaults(&tune);
+    f3_tune_drive(hDevice, device_size, is_drive && !no_tune, &tune);
+    iotune_print(&tune);
+    printf("\n");
+
+    if (is_drive && !f3_lock_volume(hDevice)) {
+        printf("Warning: Could not lock %s, writes to areas in use may fail\n\n", target);
+    }
+
+    RawLayout layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.version = RAWLAYOUT_VERSION;
+    layout.data_offset = iotune_align_up(&tune, RAWLAYOUT_DATA_OFFSET);
+    layout.data_size = (uint64_t)num_mb * 1024 * 1024;
+    layout.created = (int64_t)time(NULL);
+
+    // The header carries the seed, so the reader needs nothing else
+    F3Seed seed;
+    f3_seed_generate(&seed);
+    layout.seed_lo = seed.lo;
+    layout.seed_hi = seed.hi;
+
+    // Volumes have a fixed size; image files grow to what was asked for
+    uint64_t room = device_size > layout.data_offset ? device_size - layout.data_offset : 0;
+    if (is_drive && (num_mb == 0 || layout.data_size > room)) {
+        if (num_mb != 0) {
+            printf("Warning: Requested %d MB but only %llu MB fit\n", num_mb,
+                   (unsigned long long)(room / (1024 * 1024)));
+        }
+        layout.data_size = room;
+    }
+    if (!is_drive && num_mb == 0) {
+        printf("Error: Give the number of MB to write to an image file\n");
+        iotune_close(&tune);
+        CloseHandle(hDevice);
+        return 1;
+    }
+    layout.data_size -= layout.data_size % tune.physical_sector;
+    if (is_drive && (layout.data_size == 0 || !rawlayout_fits(&layout, device_size))) {
+        printf("Error: %s is too small or its size could not be determined\n", target);
+        iotune_close(&tune);
+        CloseHandle(hDevice);
+        return 1;
+    }
+
+    size_t chunk_size = tune.io_size * tune.queue_depth;
+    if (chunk_size < RAW_CHUNK_SIZE) {
+        chunk_size = RAW_CHUNK_SIZE;
+    }
+    chunk_size = (size_t)iotune_align_up(&tune, chunk_size);
+    size_t header_size = (size_t)iotune_align_up(&tune, RAWLAYOUT_HEADER_SIZE);
+
+    BufPool pool;
+    chunk_size = f3_pool_create(&pool, chunk_size, 1, &tune);
+    if (chunk_size == 0) {
+        iotune_close(&tune);
+        CloseHandle(hDevice);
+        return 1;
+    }
+    unsigned char *buffer = bufpool_acquire(&pool);
+    layout.block_size = chunk_size;
+
+    char seed_text[F3_SEED_TEXT_LENGTH + 1];
+    f3_seed_format(&seed, seed_text);
+    printf("Session seed: %s\n", seed_text);
+    printf("Writing %.2f MB straight to %s (filesystem is bypassed and destroyed)...\n",
+           layout.data_size / (1024.0 * 1024.0), target);
+    if (!write_raw_header(hDevice, &layout, buffer, header_size, &tune)) {
+        printf("Error: Could not write the layout header\n");
+        f3_pool_destroy(&pool);
+        iotune_close(&tune);
+        CloseHandle(hDevice);
+        return 1;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    Progress progress;
+    progress_start(&progress, "Writing", layout.data_size, NULL, 0, NULL);
+    uint64_t next_header = RAW_HEADER_INTERVAL;
+    while (layout.written < layout.data_size) {
+        uint64_t left = layout.data_size - layout.written;
+        uint64_t len = left < chunk_size ? left : chunk_size;
+
+        f3_fill_pattern(buffer, (size_t)len, layout.written, &seed);
+        uint64_t done = iotune_transfer(hDevice, layout.data_offset + layout.written,
+                                        buffer, len, 1, &tune);
+        layout.written += done;
+        progress_add(&progress, done, 0);
+        if (done != len) {
+            progress_note(&progress, "Error: Write failed at %llu MB, stopping\n",
+                          (unsigned long long)(layout.written / (1024 * 1024)));
+            break;
+        }
+
+        sync->bytes += done;
+        if (sync->mode == SYNC_BYTES && sync->bytes >= sync->interval) {
+            if (!FlushFileBuffers(hDevice)) {
+                sync->failures++;
+            }
+            sync->bytes = 0;
+        }
+
+        // Keep the header current, so an interrupted run can still be read
+        // back. The data it covers is flushed first, unless told not to.
+        if (layout.written >= next_header) {
+            if (sync->mode != SYNC_NONE && !FlushFileBuffers(hDevice)) {
+                sync->failures++;
+            }
+            write_raw_header(hDevice, &layout, buffer, header_size, &tune);
+            next_header += RAW_HEADER_INTERVAL;
+        }
+    }
+    if (sync->mode != SYNC_NONE && !FlushFileBuffers(hDevice)) {
+        sync->failures++;
+    }
+    progress_stop(&progress);
+
+    layout.complete = layout.written == layout.data_size;
+    int ok = write_raw_header(hDevice, &layout, buffer, header_size, &tune);
+    if (sync->mode != SYNC_NONE && !FlushFileBuffers(hDevice)) {
+        sync->failures++;
+    }
+    QueryPerformanceCounter(&end);
+
+    double elapsed = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
+    double written_mb = layout.written / (1024.0 * 1024.0);
+    printf("\nWrote %.2f MB in %.1f seconds, %.2f MB/s (%s)\n",
+           written_mb, elapsed, elapsed > 0 ? written_mb / elapsed : 0, describe_sync(sync));
+    if (sync->failures > 0) {
+        printf("Warning: %d flushes failed\n", sync->failures);
+    }
+    if (!ok) {
+        printf("Error: Could not update the layout header\n");
+    }
+
+    f3_pool_destroy(&pool);
+    iotune_close(&tune);
+    CloseHandle(hDevice);
+    return layout.complete && ok ? 0 : 1;
 }
 
 // Write files to test flash memory
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage: f3write.exe <PATH> [NUM_BLOCKS_MB]\n");
+int f3_write_main(int argc, char **argv) {
+    // Parse arguments
+    char *path = NULL;
+    char *blocks_arg = NULL;
+    int num_blocks = 0;  // 0 means fill the drive
+    int no_tune = 0;
+    int raw = 0;
+    SyncPolicy sync;
+    parse_sync("end", &sync);
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-tune") == 0) {
+            no_tune = 1;
+        } else if (strncmp(argv[i], "--mem-limit=", 12) == 0) {
+            if (!f3_parse_mem_limit(argv[i] + 12)) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--raw") == 0) {
+            raw = 1;
+        } else if (strncmp(argv[i], "--sync=", 7) == 0) {
+            if (!parse_sync(argv[i] + 7, &sync)) {
+                printf("Error: Invalid flush policy: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!path) {
+            path = argv[i];
+        } else if (!blocks_arg) {
+            blocks_arg = argv[i];
+        }
+    }
+    
+    if (!path) {
+        printf("Usage: f3write.exe [--no-tune] [--raw] [--sync=WHEN] [--mem-limit=MB] <PATH> "
+               "[NUM_BLOCKS_MB]\n");
         printf("F3 Write - Test flash memory capacity\n");
         printf("Example: f3write.exe E:\\ 2000\n");
         printf("         (writes 2000MB worth of test data)\n");
+        printf("  --no-tune       Skip I/O size calibration and use 1MB requests\n");
+        printf("  --raw           Write straight to the volume (E:) or an image file,\n");
+        printf("                  bypassing the filesystem. DESTROYS the filesystem.\n");
+        printf("  --sync=WHEN     Flush written data to the device: none, file (after\n");
+        printf("                  every file), end (default) or every N MB, e.g. 256\n");
+        f3_print_mem_limit_usage(16);
         return 1;
     }
-
-    // Parse arguments
-    char *path = argv[1];
-    int num_blocks = 0;  // 0 means fill the drive
     
-    if (argc >= 3) {
-        num_blocks = atoi(argv[2]);
+    if (blocks_arg) {
+        num_blocks = atoi(blocks_arg);
         if (num_blocks <= 0) {
-            printf("Error: Invalid number of blocks: %s\n", argv[2]);
+            printf("Error: Invalid number of blocks: %s\n", blocks_arg);
             return 1;
         }
     }
 
-    // Print header
-    printf("F3 Write - Test flash memory capacity v%s\n", VERSION);
-    printf("Copyright (C) 2010 Digirati Internet LTDA.\n");
-    printf("This is free software; see the source for copying conditions.\n\n");
+    f3_print_header("F3 Write - Test flash memory capacity");
 
-    // Check if the path exists and is a directory
-    DWORD attr = GetFileAttributes(path);
-    if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
-        printf("Error: %s is not a valid directory\n", path);
+    if (raw) {
+        return write_raw(path, num_blocks, no_tune, &sync);
+    }
+
+    char full_path[F3_MAX_PATH_LENGTH];
+    if (!f3_normalize_dir(path, full_path, sizeof(full_path))) {
         return 1;
     }
 
-    // Make sure path ends with backslash
-    char full_path[MAX_PATH_LENGTH];
-    strncpy(full_path, path, MAX_PATH_LENGTH - 1);
-    full_path[MAX_PATH_LENGTH - 1] = '\0';
-    
-    size_t len = strlen(full_path);
-    if (len > 0 && full_path[len - 1] != '\\' && full_path[len - 1] != '/') {
-        if (len < MAX_PATH_LENGTH - 1) {
-            full_path[len] = '\\';
-            full_path[len + 1] = '\0';
-        } else {
-            printf("Error: Path too long\n");
-            return 1;
-        }
+    // Every run writes a new pattern, so files from an earlier one are
+    // useless; removing them also gives their space back to this run
+    int deleted = delete_old_files(full_path);
+    if (deleted > 0) {
+        printf("Deleted %d test files of an earlier run\n", deleted);
     }
 
     // Check available space
@@ -101,10 +437,10 @@ int main(int argc, char **argv) {
     }
     
     double free_space = (double)free_bytes_available.QuadPart;
-    const char *free_unit = format_size(&free_space);
+    const char *free_unit = f3_format_size(&free_space);
     
     double total_space = (double)total_bytes.QuadPart;
-    const char *total_unit = format_size(&total_space);
+    const char *total_unit = f3_format_size(&total_space);
     
     printf("Free space: %.2f %s\n", free_space, free_unit);
     printf("Available to write: %.2f %s\n\n", free_space, free_unit);
@@ -125,85 +461,147 @@ int main(int argc, char **argv) {
         }
     }
 
-    // Calculate number of blocks and block size
-    g_buffer_size = DEFAULT_BLOCK_SIZE;
-    uint64_t num_blocks_to_write = bytes_to_write / g_buffer_size;
+    // Pick the request size and queue depth this volume handles best
+    IoTune tune;
+    iotune_defaults(&tune);
+    if (no_tune) {
+        HANDLE hVolume = iotune_open_volume(full_path, 0);
+        if (hVolume != INVALID_HANDLE_VALUE) {
+            iotune_query_geometry(hVolume, &tune);
+            CloseHandle(hVolume);
+        }
+    } else {
+        tune_write(full_path, available_bytes, &tune);
+    }
+    iotune_print(&tune);
+    printf("\n");
+
+    // Calculate number of blocks and block size. Each file holds at least
+    // one full burst of in-flight requests.
+    uint64_t file_size = DEFAULT_BLOCK_SIZE;
+    if (tune.io_size * tune.queue_depth > file_size) {
+        file_size = tune.io_size * tune.queue_depth;
+    }
+    file_size = ((file_size + (1024 * 1024) - 1) / (1024 * 1024)) * (1024 * 1024);
+    uint64_t num_blocks_to_write = bytes_to_write / file_size;
     
     // Adjust block size if too many blocks (for progress reporting)
     if (num_blocks_to_write > 10000) {
-        g_buffer_size = (size_t)((bytes_to_write + 9999) / 10000);
+        file_size = (bytes_to_write + 9999) / 10000;
         // Round to nearest MB for cleaner sizes
-        g_buffer_size = ((g_buffer_size + (1024 * 1024) - 1) / (1024 * 1024)) * (1024 * 1024);
-        num_blocks_to_write = bytes_to_write / g_buffer_size;
+        file_size = ((file_size + (1024 * 1024) - 1) / (1024 * 1024)) * (1024 * 1024);
+        num_blocks_to_write = bytes_to_write / file_size;
     }
     
-    // Allocate buffer
-    g_buffer = (unsigned char *)malloc(g_buffer_size);
-    if (!g_buffer) {
-        printf("Error: Out of memory\n");
+    // Files bigger than the memory limit allows are written piece by piece
+    BufPool pool;
+    g_buffer_size = f3_pool_create(&pool, (size_t)file_size, 1, &tune);
+    if (g_buffer_size == 0) {
+        iotune_close(&tune);
         return 1;
     }
+    g_buffer = bufpool_acquire(&pool);
+    
+    // A new pattern for every run; f3read finds the seed next to the files
+    F3Seed seed;
+    char seed_text[F3_SEED_TEXT_LENGTH + 1];
+    f3_seed_generate(&seed);
+    f3_seed_format(&seed, seed_text);
+    if (!f3_seed_save(full_path, &seed, file_size)) {
+        printf("Error: Could not create %s%s\n", full_path, F3_SEED_FILE);
+        f3_pool_destroy(&pool);
+        iotune_close(&tune);
+        return 1;
+    }
+    printf("Session seed: %s\n", seed_text);
+
+    // One flush of the whole volume replaces flushing file by file; it
+    // needs administrator rights
+    if (sync.mode == SYNC_BYTES || sync.mode == SYNC_END) {
+        sync.volume = iotune_open_volume(full_path, GENERIC_WRITE);
+    }
     
     // Write blocks
     printf("Writing blocks...\n");
-    time_t start_time = time(NULL);
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
     uint64_t total_written = 0;
     int file_count = 0;
     
-    // Progress reporting variables
-    int progress_percent = 0;
-    int prev_progress = -1;
+    // Progress is drawn by a reporter thread from these counters
+    Progress progress;
+    progress_start(&progress, "Writing", num_blocks_to_write * file_size,
+                   "files", num_blocks_to_write, NULL);
     
     for (uint64_t i = 0; i < num_blocks_to_write; i++) {
         // Create filename: F3_NNN.txt (NNN = file number)
-        char filename[MAX_PATH_LENGTH];
+        char filename[F3_MAX_PATH_LENGTH];
         sprintf(filename, "%sF3_%03d.txt", full_path, file_count);
         
-        // Initialize buffer with unique pattern for this block
-        init_buffer(g_buffer, g_buffer_size, file_count);
-        
-        // Open file
-        FILE *f = fopen(filename, "wb");
-        if (!f) {
-            printf("\nError: Could not create file %s\n", filename);
+        // Open file, bypassing the cache so the device sees every request
+        HANDLE hFile = CreateFile(filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                  FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED |
+                                  FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            progress_note(&progress, "Error: Could not create file %s\n", filename);
             break;
         }
         
-        // Write data
-        size_t written = fwrite(g_buffer, 1, g_buffer_size, f);
-        fclose(f);
-        
-        if (written != g_buffer_size) {
-            printf("\nError: Could not write full block to %s\n", filename);
-            break;
+        // Write this block's part of the session pattern, one buffer at a time
+        uint64_t written = 0;
+        while (written < file_size) {
+            uint64_t len = file_size - written < g_buffer_size ? file_size - written
+                                                               : g_buffer_size;
+            f3_fill_pattern(g_buffer, (size_t)len, (uint64_t)file_count * file_size + written,
+                            &seed);
+            uint64_t done = iotune_transfer(hFile, written, g_buffer, len, 1, &tune);
+            written += done;
+            progress_add(&progress, done, 0);
+            if (done != len) {
+                break;
+            }
         }
         
         total_written += written;
-        file_count++;
         
-        // Progress reporting (update every 1%)
-        progress_percent = (int)((i * 100) / num_blocks_to_write);
-        if (progress_percent != prev_progress) {
-            printf("\rProgress: %d%% (%d files)", 
-                  progress_percent, file_count);
-            fflush(stdout);
-            prev_progress = progress_percent;
+        // A partial file would read back as corrupted; drop it instead
+        if (written != file_size) {
+            CloseHandle(hFile);
+            DeleteFile(filename);
+            progress_note(&progress, "Error: Could not write full block to %s, deleted it\n",
+                          filename);
+            break;
         }
+        
+        // The policy decides when the file is flushed and closed
+        sync_file_written(&sync, hFile, written);
+        
+        file_count++;
+        progress_add(&progress, 0, 1);
+    }
+    sync_flush(&sync);
+    if (sync.volume != INVALID_HANDLE_VALUE) {
+        CloseHandle(sync.volume);
     }
-    printf("\rProgress: 100%% (%d files)   \n", file_count);
+    progress_stop(&progress);
     
-    // Print summary
-    time_t end_time = time(NULL);
-    double elapsed = difftime(end_time, start_time);
+    // Print summary; the time includes the flushes the policy asked for
+    QueryPerformanceCounter(&end);
+    double elapsed = (double)(end.QuadPart - start.QuadPart) / frequency.QuadPart;
     
     double written_mb = total_written / (1024.0 * 1024.0);
     double speed_mbps = elapsed > 0 ? written_mb / elapsed : 0;
     
-    printf("\nWrote %.2f MB in %.1f seconds, %.2f MB/s\n", 
-           written_mb, elapsed, speed_mbps);
+    printf("\nWrote %.2f MB in %.1f seconds, %.2f MB/s (%s)\n", 
+           written_mb, elapsed, speed_mbps, describe_sync(&sync));
+    if (sync.failures > 0) {
+        printf("Warning: %d flushes failed\n", sync.failures);
+    }
     
     // Clean up
-    free(g_buffer);
+    f3_pool_destroy(&pool);
+    iotune_close(&tune);
     
     return 0;
 }
\ No newline at end of file
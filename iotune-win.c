@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <string.h>
+#include <windows.h>
+#include <winioctl.h>
+
+#include "iotune-win.h"
+
+// Request sizes tried during calibration, smallest first
+static const size_t candidate_sizes[] = {
+    128 * 1024, 256 * 1024, 512 * 1024,
+    1024 * 1024, 2 * 1024 * 1024, 4 * 1024 * 1024, 8 * 1024 * 1024
+};
+#define NUM_CANDIDATE_SIZES (sizeof(candidate_sizes) / sizeof(candidate_sizes[0]))
+
+// Manual-reset events, so a completed request stays signaled until its slot
+// is reused. A slot whose event could not be created is left NULL.
+static void create_events(IoTune *t) {
+    for (int i = 0; i < IOTUNE_MAX_QUEUE_DEPTH; i++) {
+        t->events[i] = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+}
+
+void iotune_defaults(IoTune *t) {
+    memset(t, 0, sizeof(*t));
+    t->logical_sector = 512;
+    t->physical_sector = 512;
+    t->io_size = IOTUNE_DEFAULT_IO_SIZE;
+    t->queue_depth = 1;
+    create_events(t);
+}
+
+int iotune_clone(IoTune *dst, const IoTune *src) {
+    *dst = *src;
+    create_events(dst);
+    for (int i = 0; i < IOTUNE_MAX_QUEUE_DEPTH; i++) {
+        if (!dst->events[i]) {
+            iotune_close(dst);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void iotune_close(IoTune *t) {
+    for (int i = 0; i < IOTUNE_MAX_QUEUE_DEPTH; i++) {
+        if (t->events[i]) {
+            CloseHandle(t->events[i]);
+            t->events[i] = NULL;
+        }
+    }
+}
+
+int iotune_ioctl(HANDLE h, DWORD code, void *in, DWORD in_size,
+                 void *out, DWORD out_size, DWORD *returned) {
+    OVERLAPPED ov;
+    DWORD bytesReturned = 0;
+
+    // Handles opened with FILE_FLAG_OVERLAPPED need an OVERLAPPED on every
+    // call; without one, a request that pends reports garbage
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (!ov.hEvent) {
+        return 0;
+    }
+
+    BOOL ok = DeviceIoControl(h, code, in, in_size, out, out_size, NULL, &ov);
+    if (ok || GetLastError() == ERROR_IO_PENDING) {
+        ok = GetOverlappedResult(h, &ov, &bytesReturned, TRUE);
+    }
+    CloseHandle(ov.hEvent);
+
+    if (returned) {
+        *returned = bytesReturned;
+    }
+    return ok != 0;
+}
+
+int iotune_query_geometry(HANDLE h, IoTune *t) {
+    STORAGE_PROPERTY_QUERY query;
+    int found = 0;
+
+    // Logical/physical sector sizes and alignment (Windows 7 and later)
+    STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment;
+    memset(&query, 0, sizeof(query));
+    memset(&alignment, 0, sizeof(alignment));
+    query.PropertyId = StorageAccessAlignmentProperty;
+    query.QueryType = PropertyStandardQuery;
+    if (iotune_ioctl(h, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                     &alignment, sizeof(alignment), NULL) &&
+        alignment.BytesPerLogicalSector != 0) {
+        t->logical_sector = alignment.BytesPerLogicalSector;
+        t->physical_sector = alignment.BytesPerPhysicalSector;
+        t->align_offset = alignment.BytesOffsetForSectorAlignment;
+        found = 1;
+    } else {
+        // Older systems and some USB bridges only report the logical size
+        DISK_GEOMETRY geometry;
+        if (iotune_ioctl(h, IOCTL_DISK_GET_DRIVE_GEOMETRY, NULL, 0,
+                         &geometry, sizeof(geometry), NULL) &&
+            geometry.BytesPerSector != 0) {
+            t->logical_sector = geometry.BytesPerSector;
+            t->physical_sector = geometry.BytesPerSector;
+            found = 1;
+        }
+    }
+    if (t->physical_sector < t->logical_sector) {
+        t->physical_sector = t->logical_sector;
+    }
+
+    // Largest request the adapter takes without splitting it
+    STORAGE_ADAPTER_DESCRIPTOR adapter;
+    memset(&query, 0, sizeof(query));
+    memset(&adapter, 0, sizeof(adapter));
+    query.PropertyId = StorageAdapterProperty;
+    query.QueryType = PropertyStandardQuery;
+    if (iotune_ioctl(h, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query),
+                     &adapter, sizeof(adapter), NULL)) {
+        t->max_transfer = adapter.MaximumTransferLength;
+        found = 1;
+    }
+
+    return found;
+}
+
+HANDLE iotune_open_volume(const char *path, DWORD access) {
+    char mount_point[MAX_PATH];
+    char volume_name[MAX_PATH];
+
+    if (!GetVolumePathName(path, mount_point, MAX_PATH) ||
+        !GetVolumeNameForVolumeMountPoint(mount_point, volume_name, MAX_PATH)) {
+        return INVALID_HANDLE_VALUE;
+    }
+
+    // "\\?\Volume{GUID}\" opens the root directory; drop the slash to get the volume
+    size_t len = strlen(volume_name);
+    if (len > 0 && volume_name[len - 1] == '\\') {
+        volume_name[len - 1] = '\0';
+    }
+
+    return CreateFile(volume_name, access, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      NULL, OPEN_EXISTING,
+                      FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+}
+
+uint64_t iotune_transfer(HANDLE h, uint64_t offset, unsigned char *buffer,
+                         uint64_t len, int write, const IoTune *t) {
+    OVERLAPPED ov[IOTUNE_MAX_QUEUE_DEPTH];
+    DWORD lengths[IOTUNE_MAX_QUEUE_DEPTH];
+    int qd = t->queue_depth;
+    if (qd < 1) qd = 1;
+    if (qd > IOTUNE_MAX_QUEUE_DEPTH) qd = IOTUNE_MAX_QUEUE_DEPTH;
+
+    for (int i = 0; i < qd; i++) {
+        if (!t->events[i]) {
+            return 0;
+        }
+    }
+
+    uint64_t issued = 0, done = 0;
+    int head = 0, inflight = 0, failed = 0;
+
+    // Requests complete in the order they were issued, so done only
+    // counts the contiguous prefix that made it to or from the device
+    while ((!failed && issued < len) || inflight > 0) {
+        while (!failed && issued < len && inflight < qd) {
+            int slot = (head + inflight) % qd;
+            uint64_t remaining = len - issued;
+            DWORD n = (DWORD)(remaining < t->io_size ? remaining : t->io_size);
+            uint64_t pos = offset + issued;
+
+            memset(&ov[slot], 0, sizeof(ov[slot]));
+            ov[slot].Offset = (DWORD)pos;
+            ov[slot].OffsetHigh = (DWORD)(pos >> 32);
+            ov[slot].hEvent = t->events[slot];
+            ResetEvent(t->events[slot]);
+
+            BOOL ok = write
+                ? WriteFile(h, buffer + issued, n, NULL, &ov[slot])
+                : ReadFile(h, buffer + issued, n, NULL, &ov[slot]);
+            if (!ok && GetLastError() != ERROR_IO_PENDING) {
+                failed = 1;
+                break;
+            }
+
+            lengths[slot] = n;
+            issued += n;
+            inflight++;
+        }
+
+        if (inflight == 0) {
+            break;
+        }
+
+        DWORD got = 0;
+        if (!GetOverlappedResult(h, &ov[head], &got, TRUE)) {
+            failed = 1;
+        }
+        if (!failed) {
+            done += got;
+            if (got != lengths[head]) {
+                failed = 1;  // Short transfer: end of file or device
+            }
+        }
+        head = (head + 1) % qd;
+        inflight--;
+    }
+
+    return done;
+}
+
+uint64_t iotune_align_up(const IoTune *t, uint64_t size) {
+    uint64_t unit = t->physical_sector ? t->physical_sector : 512;
+    return ((size + unit - 1) / unit) * unit;
+}
+
+// Elapsed seconds since an earlier QueryPerformanceCounter sample
+static double seconds_since(const LARGE_INTEGER *start) {
+    LARGE_INTEGER frequency, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&end);
+    return (double)(end.QuadPart - start->QuadPart) / frequency.QuadPart;
+}
+
+// Move one trial's worth of data and return its throughput in MB/s, 0 on failure.
+// The cursor advances through the span so no trial re-reads cached data.
+static double run_trial(HANDLE h, uint64_t offset, uint64_t span, uint64_t *cursor,
+                        unsigned char *buffer, uint64_t trial_bytes, int write,
+                        const IoTune *t) {
+    if (*cursor + trial_bytes > span) {
+        *cursor = 0;
+    }
+
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    uint64_t done = iotune_transfer(h, offset + *cursor, buffer, trial_bytes, write, t);
+    double elapsed = seconds_since(&start);
+
+    *cursor += trial_bytes;
+    if (done != trial_bytes || elapsed <= 0) {
+        return 0;
+    }
+    return (double)done / (1024.0 * 1024.0) / elapsed;
+}
+
+int iotune_calibrate(HANDLE h, uint64_t offset, uint64_t span, int write,
+                     unsigned char *buffer, uint64_t buffer_size, IoTune *t) {
+    uint64_t trial_bytes = span < IOTUNE_TRIAL_BYTES ? span : IOTUNE_TRIAL_BYTES;
+    if (trial_bytes > buffer_size) {
+        trial_bytes = buffer_size;
+    }
+    trial_bytes -= trial_bytes % candidate_sizes[0];
+    if (trial_bytes == 0) {
+        return 0;
+    }
+
+    // Non-constant data so compressing controllers cannot shortcut the writes
+    uint32_t x = 0x9E3779B9u;
+    for (uint64_t i = 0; i < trial_bytes; i++) {
+        x = x * 1664525u + 1013904223u;
+        buffer[i] = (unsigned char)(x >> 24);
+    }
+
+    IoTune trial = *t;
+    uint64_t cursor = 0;
+    double best_mbps = 0;
+    size_t best_size = 0;
+    double size_mbps[NUM_CANDIDATE_SIZES];
+
+    // Pass 1: request size at queue depth 1
+    trial.queue_depth = 1;
+    for (size_t i = 0; i < NUM_CANDIDATE_SIZES; i++) {
+        size_mbps[i] = 0;
+        if (candidate_sizes[i] > trial_bytes ||
+            candidate_sizes[i] % t->logical_sector != 0 ||
+            (t->max_transfer != 0 && candidate_sizes[i] > t->max_transfer && i > 0)) {
+            continue;
+        }
+        trial.io_size = candidate_sizes[i];
+        size_mbps[i] = run_trial(h, offset, span, &cursor, buffer, trial_bytes, write, &trial);
+        if (size_mbps[i] > best_mbps) {
+            best_mbps = size_mbps[i];
+        }
+    }
+
+    // Prefer the smallest size within 5% of the best; larger ones only add latency
+    for (size_t i = 0; i < NUM_CANDIDATE_SIZES; i++) {
+        if (size_mbps[i] > 0 && size_mbps[i] >= best_mbps * 0.95) {
+            best_size = candidate_sizes[i];
+            best_mbps = size_mbps[i];
+            break;
+        }
+    }
+
+    if (best_size == 0) {
+        return 0;
+    }
+
+    // Pass 2: deeper queues at that size, kept only if clearly faster
+    int best_qd = 1;
+    trial.io_size = best_size;
+    for (int qd = 2; qd <= IOTUNE_MAX_QUEUE_DEPTH; qd *= 2) {
+        if ((uint64_t)best_size * qd > trial_bytes) {
+            break;
+        }
+        trial.queue_depth = qd;
+        double mbps = run_trial(h, offset, span, &cursor, buffer, trial_bytes, write, &trial);
+        if (mbps > best_mbps * 1.05) {
+            best_mbps = mbps;
+            best_qd = qd;
+        }
+    }
+
+    t->io_size = best_size;
+    t->queue_depth = best_qd;
+    t->mbps = best_mbps;
+    return 1;
+}
+
+void iotune_print(const IoTune *t) {
+    printf("Sector size: %lu bytes logical, %lu bytes physical",
+           (unsigned long)t->logical_sector, (unsigned long)t->physical_sector);
+    if (t->align_offset != 0) {
+        printf(" (misaligned by %lu bytes)", (unsigned long)t->align_offset);
+    }
+    printf("\n");
+    if (t->mbps > 0) {
+        printf("I/O size: %lu KB x %d in flight (%.2f MB/s during calibration)\n",
+               (unsigned long)(t->io_size / 1024), t->queue_depth, t->mbps);
+    } else {
+        printf("I/O size: %lu KB x %d in flight (not calibrated)\n",
+               (unsigned long)(t->io_size / 1024), t->queue_depth);
+    }
+}
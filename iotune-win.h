@@ -0,0 +1,70 @@
+#ifndef IOTUNE_WIN_H
+#define IOTUNE_WIN_H
+
+#include <stdint.h>
+#include <windows.h>
+
+#define IOTUNE_DEFAULT_IO_SIZE (1 * 1024 * 1024)  // Used when calibration is skipped
+#define IOTUNE_MAX_QUEUE_DEPTH 8
+#define IOTUNE_TRIAL_BYTES (16 * 1024 * 1024)  // Data moved per calibration trial
+
+// Device geometry and the I/O shape that performed best on it
+typedef struct {
+    DWORD logical_sector;     // Smallest addressable unit
+    DWORD physical_sector;    // Native write unit of the medium
+    DWORD align_offset;       // Offset of LBA 0 from physical sector alignment
+    DWORD max_transfer;       // Adapter limit per request, 0 if unknown
+    size_t io_size;           // Bytes per request
+    int queue_depth;          // Requests kept in flight
+    double mbps;              // Throughput measured for io_size/queue_depth, 0 if untuned
+    HANDLE events[IOTUNE_MAX_QUEUE_DEPTH];  // One per request slot, reused by every transfer
+} IoTune;
+
+// Fill in 512-byte sectors and 1MB synchronous requests, and create the
+// request events. Release them with iotune_close.
+void iotune_defaults(IoTune *t);
+
+// Copy src's geometry and request shape into dst with events of its own,
+// for a second thread doing I/O at the same time. Returns 0 on failure.
+int iotune_clone(IoTune *dst, const IoTune *src);
+
+void iotune_close(IoTune *t);
+
+// DeviceIoControl for a handle opened with FILE_FLAG_OVERLAPPED: issues the
+// request with its own event and waits for it. returned may be NULL.
+// Returns 0 on failure, with the error in GetLastError().
+int iotune_ioctl(HANDLE h, DWORD code, void *in, DWORD in_size,
+                 void *out, DWORD out_size, DWORD *returned);
+
+// Read sector sizes, alignment and transfer limit from a disk or volume handle.
+// Returns 0 if nothing could be queried (defaults are kept).
+int iotune_query_geometry(HANDLE h, IoTune *t);
+
+// Open the volume that holds path (e.g. "E:\\") for overlapped unbuffered
+// I/O with the given access. An access of 0 is enough for geometry queries
+// and needs no administrator rights; data access needs them.
+HANDLE iotune_open_volume(const char *path, DWORD access);
+
+// Time a range of request sizes and queue depths against h, starting at
+// offset and staying within span bytes, and store the fastest in t.
+// h must be opened with FILE_FLAG_OVERLAPPED and FILE_FLAG_NO_BUFFERING.
+// Trials move up to IOTUNE_TRIAL_BYTES through buffer, which must be page
+// aligned; its contents are overwritten. Returns 0 if no trial succeeded
+// (t keeps its previous io_size/queue_depth).
+int iotune_calibrate(HANDLE h, uint64_t offset, uint64_t span, int write,
+                     unsigned char *buffer, uint64_t buffer_size, IoTune *t);
+
+// Read or write len bytes at offset using up to t->queue_depth overlapped
+// requests of t->io_size bytes. Returns the number of bytes transferred
+// in order before the first failure or end of file. Only one thread at a
+// time may use t's events; others need an iotune_clone.
+uint64_t iotune_transfer(HANDLE h, uint64_t offset, unsigned char *buffer,
+                         uint64_t len, int write, const IoTune *t);
+
+// Round size up to a multiple of the physical sector size
+uint64_t iotune_align_up(const IoTune *t, uint64_t size);
+
+// Print the sector geometry on one line and the request shape on the next
+void iotune_print(const IoTune *t);
+
+#endif /* IOTUNE_WIN_H */
@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <windows.h>
+#include <winioctl.h>
+#include <wincrypt.h>
+
+#include "libf3.h"
+
+#define TUNE_SPAN (256ULL * 1024 * 1024)  // Drive region read during calibration
+
+static uint64_t g_mem_limit = F3_DEFAULT_MEM_LIMIT;
+static volatile LONG64 g_mem_used;  // Bytes held by live pools
+
+void f3_print_header(const char *title) {
+    printf("%s v%s\n", title, F3_VERSION);
+    printf("Copyright (C) 2010 Digirati Internet LTDA.\n");
+    printf("This is free software; see the source for copying conditions.\n\n");
+}
+
+const char *f3_format_size(double *size) {
+    static const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+
+    while (*size >= 1024 && unit < 4) {
+        *size /= 1024;
+        unit++;
+    }
+
+    return units[unit];
+}
+
+int f3_normalize_dir(const char *path, char *full_path, size_t size) {
+    DWORD attr = GetFileAttributes(path);
+    if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+        printf("Error: %s is not a valid directory\n", path);
+        return 0;
+    }
+
+    size_t len = strlen(path);
+    int slash = len > 0 && path[len - 1] != '\\' && path[len - 1] != '/';
+    if (len + slash + 1 > size) {
+        printf("Error: Path too long\n");
+        return 0;
+    }
+
+    memcpy(full_path, path, len);
+    if (slash) {
+        full_path[len++] = '\\';
+    }
+    full_path[len] = '\0';
+    return 1;
+}
+
+void f3_seed_generate(F3Seed *seed) {
+    HCRYPTPROV hProvider;
+    if (CryptAcquireContext(&hProvider, NULL, NULL, PROV_RSA_FULL,
+                            CRYPT_VERIFYCONTEXT | CRYPT_SILENT)) {
+        BOOL ok = CryptGenRandom(hProvider, sizeof(*seed), (BYTE *)seed);
+        CryptReleaseContext(hProvider, 0);
+        if (ok) {
+            return;
+        }
+    }
+
+    // Without a provider, mix what differs between runs; that still keeps
+    // back-to-back runs apart, which is what defeats a pattern-aware drive
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    seed->lo = f3_pattern_word((uint64_t)counter.QuadPart ^
+                               ((uint64_t)GetCurrentProcessId() << 32));
+    seed->hi = f3_pattern_word(seed->lo ^ GetTickCount64() ^ (uint64_t)(uintptr_t)seed);
+}
+
+int f3_seed_save(const char *dir, const F3Seed *seed, uint64_t block_size) {
+    char filename[F3_MAX_PATH_LENGTH];
+    char text[F3_SEED_TEXT_LENGTH + 1];
+    snprintf(filename, sizeof(filename), "%s%s", dir, F3_SEED_FILE);
+    f3_seed_format(seed, text);
+
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        return 0;
+    }
+    int ok = fprintf(file, "%s\nblock_size %llu\n", text, (unsigned long long)block_size) > 0;
+    return fclose(file) == 0 && ok;
+}
+
+int f3_seed_load(const char *dir, F3Seed *seed, uint64_t *block_size) {
+    char filename[F3_MAX_PATH_LENGTH];
+    char text[F3_SEED_TEXT_LENGTH + 2];
+    char line[64];
+    unsigned long long value;
+    snprintf(filename, sizeof(filename), "%s%s", dir, F3_SEED_FILE);
+
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        return 0;
+    }
+    int ok = fgets(text, sizeof(text), file) != NULL && f3_seed_parse(seed, text);
+    *block_size = 0;
+    if (ok && fgets(line, sizeof(line), file) && sscanf(line, "block_size %llu", &value) == 1) {
+        *block_size = value;
+    }
+    fclose(file);
+    return ok;
+}
+
+void f3_report_map(const ExtMap *map, uint64_t limit, const char *map_file) {
+    printf("Tested: ");
+    for (int state = 0; state < EXT_NUM_STATES; state++) {
+        uint64_t bytes = extmap_bytes(map, (ExtState)state);
+        if (bytes > 0 || state == EXT_GOOD) {
+            printf("%s%.2f MB %s", state == EXT_GOOD ? "" : ", ",
+                   (double)bytes / (1024 * 1024), extmap_state_name((ExtState)state));
+        }
+    }
+    printf("\n");
+
+    if (extmap_first_bad(map) != UINT64_MAX) {
+        printf("Bad ranges:\n");
+        extmap_print(map, stdout, 1);
+        uint64_t safe = extmap_safe_size(map, limit, 1024 * 1024);
+        printf("Suggested partition size: %llu MB (starting at offset 0)\n",
+               (unsigned long long)(safe / (1024 * 1024)));
+    }
+
+    if (map_file) {
+        if (extmap_save(map, map_file)) {
+            printf("Map saved to %s\n", map_file);
+        } else {
+            printf("Error: Could not save map to %s\n", map_file);
+        }
+    }
+}
+
+void f3_print_result(const F3Result *result, const char *map_file) {
+    if (result->tested == 0) {
+        return;  // The engine already said why
+    }
+    if (result->write_map.count > 0) {
+        printf("Write errors (%.2f MB):\n",
+               (double)extmap_bytes(&result->write_map, EXT_WRITE_FAILED) / (1024 * 1024));
+        extmap_print(&result->write_map, stdout, 1);
+        printf("\n");
+    } else if (result->write_errors > 0) {
+        printf("%d write requests failed\n\n", result->write_errors);
+    }
+
+    if (result->map.count > 0) {
+        f3_report_map(&result->map, result->tested, map_file);
+        printf("\n");
+        if (extmap_first_bad(&result->map) == UINT64_MAX) {
+            printf("No bad sectors found.\n");
+        }
+    }
+    if (result->restore_failures > 0) {
+        printf("Warning: %d overwritten blocks could not be restored\n",
+               result->restore_failures);
+    }
+
+    static const char *const names[] = {"GENUINE", "COUNTERFEIT", "DAMAGED"};
+    printf("Drive appears to be %s", names[result->verdict]);
+    if (result->confidence > 0) {
+        printf(" (confidence %.0f%%%s%s)", result->confidence * 100,
+               result->note ? ", " : "", result->note ? result->note : "");
+    } else if (result->note) {
+        printf(" (%s)", result->note);
+    }
+    printf("\n");
+
+    if (result->verdict != FAKE_TYPE_POSSIBLY_FAKE) {
+        return;
+    }
+    if (result->capacity_low == result->capacity_high) {
+        printf("Estimated real capacity: %llu MB\n",
+               (unsigned long long)(result->capacity_low / (1024 * 1024)));
+    } else {
+        printf("Estimated real capacity: between %llu MB and %llu MB\n",
+               (unsigned long long)(result->capacity_low / (1024 * 1024)),
+               (unsigned long long)(result->capacity_high / (1024 * 1024)));
+    }
+}
+
+HANDLE f3_open_drive(char drive_letter, int write) {
+    char drive_path[16];
+    snprintf(drive_path, sizeof(drive_path), "\\\\.\\%c:", drive_letter);
+
+    return CreateFile(drive_path,
+                      GENERIC_READ | (write ? GENERIC_WRITE : 0),
+                      FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      NULL,
+                      OPEN_EXISTING,
+                      FILE_FLAG_NO_BUFFERING | FILE_FLAG_RANDOM_ACCESS | FILE_FLAG_OVERLAPPED,
+                      NULL);
+}
+
+uint64_t f3_get_drive_size(HANDLE hDevice) {
+    // Length of the partition on a volume handle, of the medium on a disk
+    // handle
+    GET_LENGTH_INFORMATION lengthInfo;
+    if (iotune_ioctl(hDevice, IOCTL_DISK_GET_LENGTH_INFO, NULL, 0,
+                     &lengthInfo, sizeof(lengthInfo), NULL))
+    {
+        return lengthInfo.Length.QuadPart;
+    }
+
+    // The geometry describes the whole disk, so a volume must not use it:
+    // tests would run past the end of its partition. A volume is what
+    // answers the extents query; use its extent instead.
+    VOLUME_DISK_EXTENTS extents;
+    if (iotune_ioctl(hDevice, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0,
+                     &extents, sizeof(extents), NULL))
+    {
+        return extents.Extents[0].ExtentLength.QuadPart;
+    }
+    if (GetLastError() == ERROR_MORE_DATA) {
+        return 0;  // Spans several disks; no single length to test
+    }
+
+    DISK_GEOMETRY_EX diskGeometry;
+    if (iotune_ioctl(hDevice, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0,
+                     &diskGeometry, sizeof(diskGeometry), NULL))
+    {
+        return diskGeometry.DiskSize.QuadPart;
+    }
+
+    // Image files answer none of the above
+    LARGE_INTEGER fileSize;
+    if (GetFileSizeEx(hDevice, &fileSize)) {
+        return fileSize.QuadPart;
+    }
+    return 0;
+}
+
+HANDLE f3_open_raw(const char *target, int write, int *is_drive) {
+    size_t len = strlen(target);
+    *is_drive = len >= 2 && len <= 3 && target[1] == ':' &&
+                (len == 2 || target[2] == '\\' || target[2] == '/');
+    if (*is_drive) {
+        return f3_open_drive(target[0], write);
+    }
+
+    return CreateFile(target,
+                      GENERIC_READ | (write ? GENERIC_WRITE : 0),
+                      FILE_SHARE_READ,
+                      NULL,
+                      write ? OPEN_ALWAYS : OPEN_EXISTING,
+                      FILE_FLAG_NO_BUFFERING | FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_OVERLAPPED,
+                      NULL);
+}
+
+void f3_tune_drive(HANDLE hDevice, uint64_t drive_size, int calibrate, IoTune *tune) {
+    iotune_query_geometry(hDevice, tune);
+    if (!calibrate) {
+        return;
+    }
+
+    // Stay clear of the partition table
+    uint64_t tune_start = iotune_align_up(tune, 1024 * 1024);
+    uint64_t tune_span = drive_size > tune_start ? drive_size - tune_start : 0;
+    if (tune_span > TUNE_SPAN) {
+        tune_span = TUNE_SPAN;
+    }
+    f3_calibrate(hDevice, tune_start, tune_span, 0, tune);
+}
+
+void f3_calibrate(HANDLE h, uint64_t offset, uint64_t span, int write, IoTune *tune) {
+    printf("Calibrating I/O size...\n");
+
+    // The trial buffer counts against the memory limit like any other
+    BufPool pool;
+    size_t size = f3_pool_create(&pool, IOTUNE_TRIAL_BYTES, 1, tune);
+    if (size == 0 ||
+        !iotune_calibrate(h, offset, span, write, bufpool_acquire(&pool), size, tune)) {
+        printf("Calibration failed, using defaults\n");
+    }
+    if (size != 0) {
+        f3_pool_destroy(&pool);
+    }
+}
+
+int f3_lock_volume(HANDLE hDevice) {
+    if (!iotune_ioctl(hDevice, FSCTL_LOCK_VOLUME, NULL, 0, NULL, 0, NULL)) {
+        return 0;
+    }
+    iotune_ioctl(hDevice, FSCTL_DISMOUNT_VOLUME, NULL, 0, NULL, 0, NULL);
+    return 1;
+}
+
+void f3_set_mem_limit(uint64_t bytes) {
+    g_mem_limit = bytes;
+}
+
+int f3_parse_mem_limit(const char *arg) {
+    long long limit_mb = atoll(arg);
+    if (limit_mb <= 0) {
+        printf("Error: Invalid memory limit: %s\n", arg);
+        return 0;
+    }
+    f3_set_mem_limit((uint64_t)limit_mb * 1024 * 1024);
+    return 1;
+}
+
+void f3_print_mem_limit_usage(int width) {
+    printf("  %-*sBuffer memory to use at most (default %llu)\n", width, "--mem-limit=MB",
+           (unsigned long long)(F3_DEFAULT_MEM_LIMIT / (1024 * 1024)));
+}
+
+size_t f3_pool_create(BufPool *pool, size_t size, int count, const IoTune *tune) {
+    memset(pool, 0, sizeof(*pool));
+    uint64_t used = (uint64_t)g_mem_used;
+    uint64_t left = g_mem_limit > used ? g_mem_limit - used : 0;
+
+    // Every buffer is charged in whole pages, so that is what has to fit
+    size_t page = bufpool_page_size();
+    uint64_t stride = ((uint64_t)size + page - 1) / page * page;
+    if (stride * count > left) {
+        stride = left / count / page * page;
+        size_t unit = size >= tune->io_size && stride >= tune->io_size
+            ? tune->io_size : tune->physical_sector;
+        size = (size_t)(stride / unit * unit);
+    }
+    if (size == 0) {
+        printf("Error: %d buffers do not fit in the %llu MB memory limit\n", count,
+               (unsigned long long)(g_mem_limit / (1024 * 1024)));
+        return 0;
+    }
+    if (left > SIZE_MAX) {
+        left = SIZE_MAX;
+    }
+    if (!bufpool_create(pool, size, count, (size_t)left)) {
+        printf("Error: Out of memory\n");
+        return 0;
+    }
+    InterlockedExchangeAdd64(&g_mem_used, (LONG64)pool->region_size);
+    return size;
+}
+
+void f3_pool_destroy(BufPool *pool) {
+    InterlockedExchangeAdd64(&g_mem_used, -(LONG64)pool->region_size);
+    bufpool_destroy(pool);
+}
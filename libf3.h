@@ -0,0 +1,142 @@
+#ifndef LIBF3_H
+#define LIBF3_H
+
+// Public interface of the F3 engine (libf3.a). The f3 tools are thin
+// front ends over it, and other programs can link it to run the same
+// tests without spawning processes and parsing their output.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <windows.h>
+
+#include "version.h"
+#include "extmap.h"
+#include "pattern.h"
+#include "result.h"
+#include "iotune-win.h"
+#include "progress-win.h"
+#include "bufpool-win.h"
+
+#define F3_VERSION F3_STR_VERSION "-win"
+#define F3_MAX_PATH_LENGTH 256
+#define F3_SEED_FILE "F3_seed.txt"  // Session seed next to the files f3write writes
+#define F3_DEFAULT_MEM_LIMIT (256ULL * 1024 * 1024)  // Buffer memory unless --mem-limit
+
+// --- Output helpers
+
+// Print the tool name, version and copyright notice
+void f3_print_header(const char *title);
+
+// Scale size down to a readable unit and return the unit's name
+const char *f3_format_size(double *size);
+
+// Check that path is a directory and copy it to full_path with a trailing
+// backslash. Prints the reason and returns 0 on failure.
+int f3_normalize_dir(const char *path, char *full_path, size_t size);
+
+// --- Test pattern
+
+// Draw a seed from the system's random number generator
+void f3_seed_generate(F3Seed *seed);
+
+// Store or read back the seed in F3_SEED_FILE under dir, a path with a
+// trailing backslash, along with the size of each test file f3write wrote.
+// block_size loads as 0 from a file that does not record it. Return 0 on
+// failure.
+int f3_seed_save(const char *dir, const F3Seed *seed, uint64_t block_size);
+int f3_seed_load(const char *dir, F3Seed *seed, uint64_t *block_size);
+
+// --- Verification
+
+// Print what the map holds and the partition size that avoids every
+// failure, and save the map to map_file unless it is NULL
+void f3_report_map(const ExtMap *map, uint64_t limit, const char *map_file);
+
+// --- Results
+
+// Print the write errors, the map and the verdict, and save the map to
+// map_file unless it is NULL. Prints nothing for a test that never ran.
+void f3_print_result(const F3Result *result, const char *map_file);
+
+// --- Devices and buffers
+
+// Open \\.\X: for overlapped unbuffered I/O
+HANDLE f3_open_drive(char drive_letter, int write);
+
+// Bytes addressable through the handle: the partition for a volume, the
+// medium for a disk, the file size for an image. 0 if unknown.
+uint64_t f3_get_drive_size(HANDLE hDevice);
+
+// Open a raw test target: "J:" names a volume, anything else an image
+// file, which is created when opened for writing
+HANDLE f3_open_raw(const char *target, int write, int *is_drive);
+
+// Query the drive's geometry and, with calibrate, time reads near its
+// start to pick the request shape. Never writes.
+void f3_tune_drive(HANDLE hDevice, uint64_t drive_size, int calibrate, IoTune *tune);
+
+// Run iotune_calibrate on h with a trial buffer taken from the memory
+// limit, saying so when it fails and the defaults are kept
+void f3_calibrate(HANDLE h, uint64_t offset, uint64_t span, int write, IoTune *tune);
+
+// Take the volume away from the filesystem so raw writes are not refused
+int f3_lock_volume(HANDLE hDevice);
+
+// Cap on the buffer memory all pools hold at once (--mem-limit)
+void f3_set_mem_limit(uint64_t bytes);
+
+// Set the limit from the MB value of --mem-limit=. Returns 0 after printing
+// why arg is not a valid limit.
+int f3_parse_mem_limit(const char *arg);
+
+// Usage line for --mem-limit=, with the option padded to width columns
+void f3_print_mem_limit_usage(int width);
+
+// Create a pool of count buffers of up to size bytes, shrunk to whole
+// requests, or at least whole sectors, when they would not fit in what is
+// left of the memory limit. Returns the buffer size, 0 after printing why
+// the pool could not be created.
+size_t f3_pool_create(BufPool *pool, size_t size, int count, const IoTune *tune);
+void f3_pool_destroy(BufPool *pool);
+
+// --- Probes (handle from f3_open_drive, tune from iotune_*). The seed picks
+// the pattern written; each run should use a fresh one. Each fills in
+// result, which the caller frees with f3_result_free even on failure, and
+// returns its verdict.
+
+FakeType f3_probe_sample(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                         int destructive, int time_ops, const F3Seed *seed,
+                         F3Result *result);
+FakeType f3_probe_full_surface(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                               const F3Seed *seed, F3Result *result);
+FakeType f3_probe_quick(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                        double budget, double threshold, const F3Seed *seed,
+                        F3Result *result);
+
+// Write the whole device while verifying data written lag bytes earlier.
+// Unless keep_going, stops as soon as the drive is shown to be a fake.
+FakeType f3_certify(HANDLE hDevice, uint64_t drive_size, const IoTune *tune,
+                    uint64_t lag, int keep_going, const F3Seed *seed, F3Result *result);
+
+// Rewrite the whole device cycles times with a new pattern derived from seed
+// each cycle. A second thread checks fresh data lag bytes behind the writes
+// and each cycle's data again just before the next cycle overwrites it.
+// Stops early after hours (0 for no limit); dwell_minutes idles between
+// cycles while re-reading a slice of the data every minute. One CSV line
+// per cycle goes to log_file unless it is NULL. The map in result holds
+// every range that failed in any cycle; the verdict is FAKE_TYPE_GOOD if no
+// error was seen, FAKE_TYPE_DAMAGED otherwise.
+FakeType f3_endurance(HANDLE hDevice, uint64_t drive_size, const IoTune *tune, uint64_t lag,
+                      int cycles, double hours, double dwell_minutes, const F3Seed *seed,
+                      const char *log_file, F3Result *result);
+
+// --- Commands, taking the same arguments as the standalone tools.
+// argv[0] is the command name. Return the process exit code.
+
+int f3_write_main(int argc, char **argv);
+int f3_read_main(int argc, char **argv);
+int f3_probe_main(int argc, char **argv);
+int f3_certify_main(int argc, char **argv);
+int f3_endurance_main(int argc, char **argv);
+
+#endif /* LIBF3_H */
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pattern.h"
+
+void f3_seed_format(const F3Seed *seed, char *text) {
+    snprintf(text, F3_SEED_TEXT_LENGTH + 1, "%016llx%016llx",
+             (unsigned long long)seed->hi, (unsigned long long)seed->lo);
+}
+
+int f3_seed_parse(F3Seed *seed, const char *text) {
+    uint64_t half[2] = {0, 0};
+    for (int i = 0; i < F3_SEED_TEXT_LENGTH; i++) {
+        char c = text[i];
+        int digit = c >= '0' && c <= '9' ? c - '0'
+                  : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) {
+            return 0;
+        }
+        half[i / 16] = (half[i / 16] << 4) | (uint64_t)digit;
+    }
+    seed->hi = half[0];
+    seed->lo = half[1];
+    return 1;
+}
+
+uint64_t f3_pattern_word(uint64_t index) {
+    uint64_t z = index * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t f3_pattern_index(uint64_t z) {
+    z = z ^ (z >> 31) ^ (z >> 62);
+    z *= 0x319642B2D24D8EC3ULL;
+    z = z ^ (z >> 27) ^ (z >> 54);
+    z *= 0x96DE1B173F119089ULL;
+    z = z ^ (z >> 30) ^ (z >> 60);
+    return z * 0xF1DE83E19937733DULL;
+}
+
+void f3_fill_pattern(unsigned char *buffer, size_t size, uint64_t pos, const F3Seed *seed) {
+    uint64_t *words = (uint64_t *)buffer;
+    uint64_t index = seed->lo + pos / 8;
+    for (size_t i = 0; i < size / 8; i++) {
+        words[i] = f3_pattern_word(index + i) ^ seed->hi;
+    }
+}
+
+uint64_t f3_pattern_source(const unsigned char *data, size_t size, const F3Seed *seed) {
+    const uint64_t *words = (const uint64_t *)data;
+    size_t last = size / 8 - 1;
+    return (f3_pattern_index(words[last] ^ seed->hi) - seed->lo - last) * 8;
+}
+
+ExtState f3_classify_sector(const unsigned char *data, size_t size, const F3Seed *seed) {
+    const uint64_t *words = (const uint64_t *)data;
+    size_t count = size / 8;
+
+    // Unmapped or erased flash reads back as all zeros or all ones
+    size_t i = 1;
+    if (words[0] == 0 || words[0] == ~0ULL) {
+        while (i < count && words[i] == words[0]) i++;
+        if (i == count) {
+            return EXT_ZERO;
+        }
+    }
+
+    // This run's pattern for another offset means writes wrapped around.
+    // Data left by an earlier run, under another seed, counts as changed.
+    uint64_t index = f3_pattern_index(words[count - 1] ^ seed->hi) - (count - 1);
+    for (i = 0; i < count; i++) {
+        if (words[i] != (f3_pattern_word(index + i) ^ seed->hi)) {
+            return EXT_CHANGED;
+        }
+    }
+    return EXT_OVERWRITTEN;
+}
+
+uint64_t f3_verify_block(ExtMap *map, uint64_t pos, const unsigned char *expected,
+                         const unsigned char *actual, size_t size, size_t sector,
+                         const F3Seed *seed) {
+    if (memcmp(expected, actual, size) == 0) {
+        extmap_set(map, pos, pos + size, EXT_GOOD);
+        return 0;
+    }
+    uint64_t bad = 0;
+    for (size_t s = 0; s < size; s += sector) {
+        size_t len = size - s < sector ? size - s : sector;
+        ExtState state = EXT_GOOD;
+        if (memcmp(expected + s, actual + s, len) != 0) {
+            state = f3_classify_sector(actual + s, len, seed);
+            bad += len;
+        }
+        extmap_set(map, pos + s, pos + s + len, state);
+    }
+    return bad;
+}
+
+uint64_t f3_wrap_distance(const unsigned char *actual, const unsigned char *expected,
+                          uint64_t pos, size_t len, size_t sector, const F3Seed *seed,
+                          uint64_t *at) {
+    for (size_t s = 0; s + sector <= len; s += sector) {
+        if (memcmp(expected + s, actual + s, sector) == 0 ||
+            f3_classify_sector(actual + s, sector, seed) != EXT_OVERWRITTEN) {
+            continue;
+        }
+        uint64_t source = f3_pattern_source(actual + s, sector, seed);
+        if (source > pos + s) {
+            *at = pos + s;
+            return source - (pos + s);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+// The test pattern and the verification built on it. Pure computation, so
+// it builds anywhere; libf3.h adds seed generation and storage.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "extmap.h"
+
+#define F3_SEED_TEXT_LENGTH 32  // Hex digits in a formatted seed
+
+// Picks the pattern a run writes. Every run draws a new one, so no two runs
+// write the same bytes and a drive cannot recognize or deduplicate them;
+// only the seed has to be kept to verify the data later.
+typedef struct {
+    uint64_t lo;  // Offsets the word index
+    uint64_t hi;  // Mixed into every word
+} F3Seed;
+
+// Seed as hex digits; text must hold F3_SEED_TEXT_LENGTH + 1 bytes
+void f3_seed_format(const F3Seed *seed, char *text);
+
+// Parse what f3_seed_format wrote. Returns 0 if text is not a seed.
+int f3_seed_parse(F3Seed *seed, const char *text);
+
+// Pattern word for a word index (splitmix64) and its inverse
+uint64_t f3_pattern_word(uint64_t index);
+uint64_t f3_pattern_index(uint64_t word);
+
+// Fill buffer with the seed's pattern for bytes [pos, pos + size). Each
+// 8-byte word depends only on the seed and its absolute position, so any
+// part can be regenerated independently.
+void f3_fill_pattern(unsigned char *buffer, size_t size, uint64_t pos, const F3Seed *seed);
+
+// Position whose pattern the 8-byte-aligned data at hand would be, judged
+// by its last word. Only meaningful when f3_classify_sector found it
+// EXT_OVERWRITTEN.
+uint64_t f3_pattern_source(const unsigned char *data, size_t size, const F3Seed *seed);
+
+// Work out what a sector that failed to match its pattern holds instead
+ExtState f3_classify_sector(const unsigned char *data, size_t size, const F3Seed *seed);
+
+// How far back the data of [pos, pos + len) wraps around: the distance to
+// the later offset its first relocated sector was written for, with that
+// sector's position in at, or 0 when no sector was relocated
+uint64_t f3_wrap_distance(const unsigned char *actual, const unsigned char *expected,
+                          uint64_t pos, size_t len, size_t sector, const F3Seed *seed,
+                          uint64_t *at);
+
+// Compare a block with what was expected and record it in the map, one run
+// per mismatching sector. Returns the bytes that did not match, 0 when the
+// whole block did; the rest of size is good.
+uint64_t f3_verify_block(ExtMap *map, uint64_t pos, const unsigned char *expected,
+                         const unsigned char *actual, size_t size, size_t sector,
+                         const F3Seed *seed);
+
+#endif /* PATTERN_H */
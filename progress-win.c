@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <windows.h>
+
+#include "progress-win.h"
+
+#define CONSOLE_INTERVAL_MS 250   // Redraw rate on a console
+#define LOG_INTERVAL_MS 5000      // Line rate when stdout is redirected
+#define RATE_WINDOW 5.0           // Seconds the smoothed rate mostly reflects
+#define LINE_WIDTH 79
+
+static double seconds_between(const LARGE_INTEGER *from, const LARGE_INTEGER *to) {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return (double)(to->QuadPart - from->QuadPart) / frequency.QuadPart;
+}
+
+// Draw the status line from the current counters
+static void render(Progress *p, int final) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    double elapsed = seconds_between(&p->start, &now);
+
+    uint64_t bytes = (uint64_t)p->done_bytes;
+    uint64_t items = (uint64_t)p->done_items;
+    uint64_t errors = (uint64_t)p->errors;
+    double rate = final ? (elapsed > 0 ? bytes / elapsed : 0) : p->rate;
+
+    char line[256];
+    int n = snprintf(line, sizeof(line), "%s: ", p->label);
+    if (p->total_bytes > 0) {
+        n += snprintf(line + n, sizeof(line) - n, "%3d%% %.2f/%.2f MB",
+                      (int)(bytes * 100 / p->total_bytes),
+                      bytes / (1024.0 * 1024.0), p->total_bytes / (1024.0 * 1024.0));
+    } else {
+        n += snprintf(line + n, sizeof(line) - n, "%.2f MB", bytes / (1024.0 * 1024.0));
+    }
+    if (p->items_label) {
+        if (p->total_items > 0) {
+            n += snprintf(line + n, sizeof(line) - n, ", %llu/%llu %s",
+                          (unsigned long long)items, (unsigned long long)p->total_items,
+                          p->items_label);
+        } else {
+            n += snprintf(line + n, sizeof(line) - n, ", %llu %s",
+                          (unsigned long long)items, p->items_label);
+        }
+    }
+    if (p->errors_label) {
+        n += snprintf(line + n, sizeof(line) - n, ", %llu %s",
+                      (unsigned long long)errors, p->errors_label);
+    }
+    n += snprintf(line + n, sizeof(line) - n, ", %.2f MB/s", rate / (1024 * 1024));
+    if (final) {
+        snprintf(line + n, sizeof(line) - n, " in %.1fs", elapsed);
+    } else if (rate > 0 && p->total_bytes > bytes) {
+        uint64_t eta = (uint64_t)((p->total_bytes - bytes) / rate);
+        snprintf(line + n, sizeof(line) - n, ", ETA %llu:%02u:%02u",
+                 (unsigned long long)(eta / 3600), (unsigned)(eta / 60 % 60), (unsigned)(eta % 60));
+    }
+
+    EnterCriticalSection(&p->console_lock);
+    if (p->interactive) {
+        printf("\r%-*s%s", LINE_WIDTH, line, final ? "\n" : "");
+    } else {
+        printf("%s\n", line);
+    }
+    fflush(stdout);
+    LeaveCriticalSection(&p->console_lock);
+}
+
+static DWORD WINAPI reporter(LPVOID arg) {
+    Progress *p = (Progress *)arg;
+    DWORD interval = p->interactive ? CONSOLE_INTERVAL_MS : LOG_INTERVAL_MS;
+    LARGE_INTEGER last = p->start, now;
+    uint64_t last_bytes = 0;
+
+    while (WaitForSingleObject(p->stop_event, interval) == WAIT_TIMEOUT) {
+        QueryPerformanceCounter(&now);
+        double dt = seconds_between(&last, &now);
+        uint64_t bytes = (uint64_t)p->done_bytes;
+
+        // Exponential moving average, so one slow request does not swing the ETA
+        if (dt > 0) {
+            double instant = (bytes - last_bytes) / dt;
+            double alpha = 1.0 - exp(-dt / RATE_WINDOW);
+            p->rate = p->rate == 0 ? instant : p->rate + alpha * (instant - p->rate);
+        }
+        last = now;
+        last_bytes = bytes;
+
+        render(p, 0);
+    }
+    return 0;
+}
+
+void progress_start(Progress *p, const char *label, uint64_t total_bytes,
+                    const char *items_label, uint64_t total_items,
+                    const char *errors_label) {
+    p->done_bytes = 0;
+    p->done_items = 0;
+    p->errors = 0;
+    p->label = label;
+    p->items_label = items_label;
+    p->errors_label = errors_label;
+    p->total_bytes = total_bytes;
+    p->total_items = total_items;
+    p->rate = 0;
+    p->interactive = GetFileType(GetStdHandle(STD_OUTPUT_HANDLE)) == FILE_TYPE_CHAR;
+    InitializeCriticalSection(&p->console_lock);
+    QueryPerformanceCounter(&p->start);
+
+    // Without a reporter only the final line is printed
+    p->thread = NULL;
+    p->stop_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (p->stop_event) {
+        p->thread = CreateThread(NULL, 0, reporter, p, 0, NULL);
+    }
+}
+
+void progress_stop(Progress *p) {
+    if (p->thread) {
+        SetEvent(p->stop_event);
+        WaitForSingleObject(p->thread, INFINITE);
+        CloseHandle(p->thread);
+    }
+    if (p->stop_event) {
+        CloseHandle(p->stop_event);
+    }
+
+    render(p, 1);
+    DeleteCriticalSection(&p->console_lock);
+}
+
+void progress_note(Progress *p, const char *format, ...) {
+    va_list args;
+
+    EnterCriticalSection(&p->console_lock);
+    if (p->interactive) {
+        printf("\r%-*s\r", LINE_WIDTH, "");
+    }
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    fflush(stdout);
+    LeaveCriticalSection(&p->console_lock);
+}
@@ -0,0 +1,52 @@
+#ifndef PROGRESS_WIN_H
+#define PROGRESS_WIN_H
+
+#include <stdint.h>
+#include <windows.h>
+
+// Progress of one pass. Workers only bump the counters; a reporter thread
+// renders them at a fixed rate, so I/O never waits on the console.
+typedef struct {
+    volatile LONG64 done_bytes;
+    volatile LONG64 done_items;
+    volatile LONG64 errors;
+
+    // Set by progress_start, read-only afterwards
+    const char *label;        // "Writing", "Verifying", ...
+    const char *items_label;  // "files", "points"; NULL hides the item count
+    const char *errors_label; // "corrupted", "mismatches"; NULL hides errors
+    uint64_t total_bytes;
+    uint64_t total_items;
+    int interactive;          // Console: redraw one line; redirected: log lines
+
+    // Reporter state
+    HANDLE thread;
+    HANDLE stop_event;
+    CRITICAL_SECTION console_lock;
+    LARGE_INTEGER start;
+    double rate;              // Smoothed bytes per second
+} Progress;
+
+// Start the reporter thread. total_items may be 0 when unknown.
+void progress_start(Progress *p, const char *label, uint64_t total_bytes,
+                    const char *items_label, uint64_t total_items,
+                    const char *errors_label);
+
+// Stop the reporter and print the final line with the average rate
+void progress_stop(Progress *p);
+
+static inline void progress_add(Progress *p, uint64_t bytes, uint64_t items) {
+    InterlockedExchangeAdd64(&p->done_bytes, (LONG64)bytes);
+    if (items) {
+        InterlockedExchangeAdd64(&p->done_items, (LONG64)items);
+    }
+}
+
+static inline void progress_error(Progress *p) {
+    InterlockedExchangeAdd64(&p->errors, 1);
+}
+
+// Print a message between status updates without garbling the status line
+void progress_note(Progress *p, const char *format, ...);
+
+#endif /* PROGRESS_WIN_H */
@@ -0,0 +1,49 @@
+#include "quickplan.h"
+
+// Add pos to the probe order unless it is out of range, unaligned or
+// already listed
+static int add_point(uint64_t *points, int count, uint64_t pos, uint64_t first,
+                     uint64_t last, uint64_t sector) {
+    if (pos < first || pos > last || pos % sector != 0 || count >= QUICK_MAX_POINTS) {
+        return count;
+    }
+    for (int i = 0; i < count; i++) {
+        if (points[i] == pos) {
+            return count;
+        }
+    }
+    points[count] = pos;
+    return count + 1;
+}
+
+int quickplan_points(uint64_t *points, uint64_t drive_size, uint64_t block_size,
+                     uint64_t sector) {
+    if (block_size == 0 || sector == 0 || drive_size < 2 * block_size) {
+        return 0;
+    }
+    uint64_t first = block_size;  // Keep clear of the partition table
+    uint64_t last = drive_size - block_size;
+    last -= last % sector;
+    int count = 0;
+    
+    count = add_point(points, count, last, first, last, sector);
+    
+    uint64_t boundary = 1;
+    while (boundary <= drive_size / 2) {
+        boundary *= 2;
+    }
+    for (; boundary >= 64ULL * 1024 * 1024; boundary /= 2) {
+        count = add_point(points, count, boundary, first, last, sector);
+        count = add_point(points, count, boundary - block_size, first, last, sector);
+    }
+    
+    for (int level = 1; level <= QUICK_LEVELS; level++) {
+        uint64_t parts = 1ULL << level;
+        for (int64_t j = (int64_t)parts - 1; j >= 1; j -= 2) {
+            uint64_t pos = drive_size / parts * j;
+            count = add_point(points, count, pos - pos % block_size, first, last, sector);
+        }
+    }
+    
+    return count;
+}
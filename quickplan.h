@@ -0,0 +1,18 @@
+#ifndef QUICKPLAN_H
+#define QUICKPLAN_H
+
+#include <stdint.h>
+
+#define QUICK_MAX_POINTS 4096
+#define QUICK_LEVELS 12  // Finest subdivision is 1/4096 of the device
+
+// Order probe locations so the most telling ones come first: the end of the
+// device, both sides of each power-of-two capacity below it, then ever finer
+// subdivisions of the device, highest offsets first within each level.
+// points must hold QUICK_MAX_POINTS entries. Every point is a multiple of
+// sector, skips the first block and ends within drive_size. Returns the
+// number of points, 0 if the device is too small to hold any.
+int quickplan_points(uint64_t *points, uint64_t drive_size, uint64_t block_size,
+                     uint64_t sector);
+
+#endif /* QUICKPLAN_H */
@@ -0,0 +1,67 @@
+#include <string.h>
+
+#include "rawlayout.h"
+
+static const char magic[8] = {'F', '3', 'R', 'A', 'W', 'L', 'Y', '1'};
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// FNV-1a over the magic and fields
+static uint64_t checksum(const unsigned char *buf, int len) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ buf[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+void rawlayout_encode(const RawLayout *layout, unsigned char *buf) {
+    memset(buf, 0, RAWLAYOUT_HEADER_SIZE);
+    memcpy(buf, magic, sizeof(magic));
+    put_u64(buf + 8, ((uint64_t)layout->complete << 32) | layout->version);
+    put_u64(buf + 16, layout->data_offset);
+    put_u64(buf + 24, layout->data_size);
+    put_u64(buf + 32, layout->written);
+    put_u64(buf + 40, layout->block_size);
+    put_u64(buf + 48, layout->seed_lo);
+    put_u64(buf + 56, (uint64_t)layout->created);
+    put_u64(buf + 64, layout->seed_hi);
+    put_u64(buf + 72, checksum(buf, 72));
+}
+
+int rawlayout_decode(RawLayout *layout, const unsigned char *buf) {
+    if (memcmp(buf, magic, sizeof(magic)) != 0 || get_u64(buf + 72) != checksum(buf, 72)) {
+        return 0;
+    }
+
+    uint64_t word = get_u64(buf + 8);
+    layout->version = (uint32_t)word;
+    layout->complete = (uint32_t)(word >> 32);
+    layout->data_offset = get_u64(buf + 16);
+    layout->data_size = get_u64(buf + 24);
+    layout->written = get_u64(buf + 32);
+    layout->block_size = get_u64(buf + 40);
+    layout->seed_lo = get_u64(buf + 48);
+    layout->created = (int64_t)get_u64(buf + 56);
+    layout->seed_hi = get_u64(buf + 64);
+
+    return layout->version == RAWLAYOUT_VERSION && layout->written <= layout->data_size &&
+           layout->data_offset >= RAWLAYOUT_HEADER_SIZE;
+}
+
+int rawlayout_fits(const RawLayout *layout, uint64_t device_size) {
+    return layout->data_offset <= device_size &&
+           layout->data_size <= device_size - layout->data_offset;
+}
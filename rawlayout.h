@@ -0,0 +1,37 @@
+#ifndef RAWLAYOUT_H
+#define RAWLAYOUT_H
+
+#include <stdint.h>
+
+// Header at the start of a partition or image written by f3write --raw.
+// The pattern fills [data_offset, data_offset + data_size); its position 0
+// is data_offset, so a reader regenerates it from this header alone.
+// Fields are stored little-endian at fixed offsets, so the layout does not
+// depend on the platform that wrote it.
+
+#define RAWLAYOUT_HEADER_SIZE 4096
+#define RAWLAYOUT_DATA_OFFSET (1024 * 1024)  // Keeps the data erase-block aligned
+#define RAWLAYOUT_VERSION 2  // Version 1 had a 64-bit seed
+
+typedef struct {
+    uint32_t version;
+    uint32_t complete;      // Set once every planned byte has been written
+    uint64_t data_offset;
+    uint64_t data_size;     // Bytes the writer planned to write
+    uint64_t written;       // Bytes written when the header was last updated
+    uint64_t block_size;    // Request size used for writing
+    uint64_t seed_lo;       // 128-bit session seed the pattern was written with
+    uint64_t seed_hi;
+    int64_t created;        // Time writing started, seconds since 1970
+} RawLayout;
+
+// Serialize into buf, which must hold RAWLAYOUT_HEADER_SIZE bytes
+void rawlayout_encode(const RawLayout *layout, unsigned char *buf);
+
+// Parse buf. Returns 0 if it does not hold a valid header.
+int rawlayout_decode(RawLayout *layout, const unsigned char *buf);
+
+// Whether the data region ends within a device of device_size bytes
+int rawlayout_fits(const RawLayout *layout, uint64_t device_size);
+
+#endif /* RAWLAYOUT_H */
@@ -0,0 +1,61 @@
+#include <string.h>
+
+#include "result.h"
+
+void f3_result_init(F3Result *result) {
+    memset(result, 0, sizeof(*result));
+    result->verdict = FAKE_TYPE_DAMAGED;  // Until an engine gets far enough to judge
+    extmap_init(&result->map, EXTMAP_DEFAULT_MAX_RUNS);
+    extmap_init(&result->write_map, EXTMAP_DEFAULT_MAX_RUNS);
+}
+
+void f3_result_free(F3Result *result) {
+    extmap_free(&result->map);
+    extmap_free(&result->write_map);
+}
+
+uint64_t f3_result_verify(F3Result *result, uint64_t pos, const unsigned char *expected,
+                          const unsigned char *actual, size_t size, size_t sector,
+                          const F3Seed *seed) {
+    uint64_t bad = f3_verify_block(&result->map, pos, expected, actual, size, sector, seed);
+    if (bad > 0) {
+        // Once the whole device has been written, data at the start reads
+        // back what was written last for it, several wraps later; the
+        // shortest distance seen is the real capacity
+        uint64_t at;
+        uint64_t wrap = f3_wrap_distance(actual, expected, pos, size, sector, seed, &at);
+        if (wrap > 0 && (result->wrap == 0 || wrap < result->wrap)) {
+            result->wrap = wrap;
+        }
+    }
+    return bad;
+}
+
+FakeType f3_judge_surface(F3Result *result) {
+    uint64_t surface = result->tested;
+    uint64_t first_bad = extmap_first_bad(&result->map);
+    uint64_t bad_bytes = surface - extmap_bytes(&result->map, EXT_GOOD);
+
+    result->usable_size = extmap_safe_size(&result->map, surface, 1024 * 1024);
+    if (result->wrap > 0) {
+        // Only the wrap distance is real, however little of the surface
+        // reads back bad: the last copy written of each block survives
+        uint64_t usable = result->wrap < surface ? result->wrap : surface;
+        result->verdict = FAKE_TYPE_POSSIBLY_FAKE;
+        result->note = "writes wrap around";
+        result->capacity_low = result->wrap;
+        result->capacity_high = result->wrap;
+        result->usable_size = usable - usable % (1024 * 1024);
+    } else if (first_bad == UINT64_MAX && result->write_errors == 0) {
+        result->verdict = FAKE_TYPE_GOOD;
+    } else if (first_bad > 0 && first_bad != UINT64_MAX &&
+               (double)bad_bytes >= 0.9 * (surface - first_bad)) {
+        // A fake's storage ends somewhere and nearly everything after it fails
+        result->verdict = FAKE_TYPE_POSSIBLY_FAKE;
+        result->capacity_low = first_bad;
+        result->capacity_high = first_bad;
+    } else {
+        result->verdict = FAKE_TYPE_DAMAGED;
+    }
+    return result->verdict;
+}
@@ -0,0 +1,53 @@
+#ifndef RESULT_H
+#define RESULT_H
+
+// Verdicts and the result the probe and certification engines fill in.
+// Judging does no I/O, so it builds anywhere.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "extmap.h"
+#include "pattern.h"
+
+typedef enum {
+    FAKE_TYPE_GOOD,
+    FAKE_TYPE_POSSIBLY_FAKE,
+    FAKE_TYPE_DAMAGED
+} FakeType;
+
+// What a probe or certification found. The engines fill it in and print
+// only their progress; f3_print_result shows it.
+typedef struct {
+    FakeType verdict;
+    const char *note;          // Qualifies the verdict, e.g. "writes wrap around"; may be NULL
+    double confidence;         // Estimated by the quick probe only, 0 elsewhere
+    uint64_t tested;           // The verdict covers [0, tested); 0 if the test never ran
+    uint64_t capacity_low;     // Real capacity lies in [capacity_low, capacity_high];
+    uint64_t capacity_high;    // set for FAKE_TYPE_POSSIBLY_FAKE only
+    uint64_t usable_size;      // Partition size from offset 0 that avoids every failure
+    int write_errors;          // Write requests that failed
+    int restore_failures;      // Blocks the quick probe could not put back
+    ExtMap map;                // What each tested range read back as
+    ExtMap write_map;          // Where writes failed, if the engine tracks ranges
+    uint64_t wrap;             // Shortest distance data was seen to wrap around by, 0 if never
+} F3Result;
+
+// Start an empty result; f3_result_free releases it
+void f3_result_init(F3Result *result);
+void f3_result_free(F3Result *result);
+
+// Compare a block with what was expected like f3_verify_block, recording it
+// in result->map, and keep the shortest wrap distance its sectors show in
+// result->wrap. Returns the bytes that did not match.
+uint64_t f3_result_verify(F3Result *result, uint64_t pos, const unsigned char *expected,
+                          const unsigned char *actual, size_t size, size_t sector,
+                          const F3Seed *seed);
+
+// Set the verdict for [0, result->tested) once all of it has been verified
+// into result->map, and return it. Data that wrapped around marks a fake
+// whose capacity is the wrap distance; otherwise a fake is a drive where
+// nearly everything past the first failure fails.
+FakeType f3_judge_surface(F3Result *result);
+
+#endif /* RESULT_H */
@@ -0,0 +1,23 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// Minimal assertions for the host-built unit tests. A failed check is
+// reported and counted, and the test carries on so one run shows them all.
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+                    #cond);                                                  \
+            check_failures++;                                                \
+        }                                                                    \
+    } while (0)
+
+// Exit status of a test program
+#define CHECK_RESULT() (check_failures ? 1 : 0)
+
+#endif /* CHECK_H */
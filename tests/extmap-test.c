@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "extmap.h"
+#include "check.h"
+
+#define MAP_FILE "extmap-test.map"
+
+// Runs sorted, non-empty, non-overlapping and merged where they touch
+static int well_formed(const ExtMap *map) {
+    for (int i = 0; i < map->count; i++) {
+        if (map->runs[i].start >= map->runs[i].end) {
+            return 0;
+        }
+        if (i > 0 && (map->runs[i - 1].end > map->runs[i].start ||
+                      (map->runs[i - 1].end == map->runs[i].start &&
+                       map->runs[i - 1].state == map->runs[i].state))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// State recorded at pos, EXT_NUM_STATES if untested
+static ExtState state_at(const ExtMap *map, uint64_t pos) {
+    for (int i = 0; i < map->count; i++) {
+        if (map->runs[i].start <= pos && pos < map->runs[i].end) {
+            return map->runs[i].state;
+        }
+    }
+    return EXT_NUM_STATES;
+}
+
+static void test_set(void) {
+    ExtMap map;
+    extmap_init(&map, 0);
+
+    // Ascending appends of one state merge
+    CHECK(extmap_set(&map, 0, 4096, EXT_GOOD));
+    CHECK(extmap_set(&map, 4096, 8192, EXT_GOOD));
+    CHECK(map.count == 1 && map.runs[0].end == 8192);
+
+    // Overwriting the middle splits the run
+    CHECK(extmap_set(&map, 1024, 2048, EXT_ZERO));
+    CHECK(map.count == 3 && well_formed(&map));
+    CHECK(state_at(&map, 1023) == EXT_GOOD);
+    CHECK(state_at(&map, 1024) == EXT_ZERO);
+    CHECK(state_at(&map, 2048) == EXT_GOOD);
+
+    // Marking it good again merges back into one run
+    CHECK(extmap_set(&map, 1024, 2048, EXT_GOOD));
+    CHECK(map.count == 1);
+
+    // A range spanning several runs and a gap replaces them all
+    CHECK(extmap_set(&map, 16384, 20480, EXT_CHANGED));
+    CHECK(extmap_set(&map, 4096, 18432, EXT_UNREADABLE));
+    CHECK(well_formed(&map));
+    CHECK(extmap_bytes(&map, EXT_UNREADABLE) == 18432 - 4096);
+    CHECK(extmap_bytes(&map, EXT_CHANGED) == 20480 - 18432);
+    CHECK(extmap_first_bad(&map) == 4096);
+    CHECK(extmap_safe_size(&map, 1 << 20, 512) == 4096);
+
+    extmap_free(&map);
+}
+
+static void test_coarsen(void) {
+    ExtMap map;
+    extmap_init(&map, 16);
+
+    // Alternating short bad and good runs, far more than the map may hold
+    const int runs = 200;
+    for (int i = 0; i < runs; i++) {
+        ExtState state = i % 2 == 0 ? EXT_CHANGED : EXT_GOOD;
+        CHECK(extmap_set(&map, (uint64_t)i * 512, (uint64_t)(i + 1) * 512, state));
+        CHECK(map.count <= map.max_runs);
+    }
+    CHECK(map.coarsened);
+    CHECK(well_formed(&map));
+    CHECK(map.max_runs == 16);
+
+    // Nothing bad may turn good, and the covered range is unchanged
+    for (int i = 0; i < runs; i += 2) {
+        CHECK(state_at(&map, (uint64_t)i * 512) == EXT_CHANGED);
+    }
+    CHECK(map.runs[0].start == 0);
+    CHECK(map.runs[map.count - 1].end == (uint64_t)runs * 512);
+    CHECK(extmap_first_bad(&map) == 0);
+    CHECK(extmap_bytes(&map, EXT_CHANGED) >= (uint64_t)runs / 2 * 512);
+
+    extmap_free(&map);
+}
+
+static void test_coarsen_gaps(void) {
+    ExtMap map;
+    extmap_init(&map, 16);
+
+    // Good runs separated by untested gaps cannot be merged; the limit
+    // grows instead and every run is kept
+    const int runs = 100;
+    for (int i = 0; i < runs; i++) {
+        CHECK(extmap_set(&map, (uint64_t)i * 8192, (uint64_t)i * 8192 + 4096, EXT_GOOD));
+    }
+    CHECK(map.count == runs);
+    CHECK(map.max_runs >= runs);
+    CHECK(well_formed(&map));
+    CHECK(extmap_bytes(&map, EXT_GOOD) == (uint64_t)runs * 4096);
+
+    extmap_free(&map);
+}
+
+static void test_save_load(void) {
+    ExtMap map, loaded;
+    extmap_init(&map, 16);
+    for (int i = 0; i < 100; i++) {
+        CHECK(extmap_set(&map, (uint64_t)i * 512, (uint64_t)(i + 1) * 512,
+                         (ExtState)(i % EXT_NUM_STATES)));
+    }
+    CHECK(map.coarsened);
+
+    CHECK(extmap_save(&map, MAP_FILE));
+    extmap_init(&loaded, 0);
+    CHECK(extmap_load(&loaded, MAP_FILE));
+    CHECK(loaded.coarsened == map.coarsened);
+    CHECK(loaded.count == map.count);
+    if (loaded.count == map.count) {
+        CHECK(memcmp(loaded.runs, map.runs, map.count * sizeof(Extent)) == 0);
+    }
+    extmap_free(&loaded);
+    extmap_free(&map);
+
+    // Unknown states and headers are rejected
+    FILE *f = fopen(MAP_FILE, "w");
+    CHECK(f != NULL);
+    if (f) {
+        fprintf(f, "f3-extmap 1 0\n0 512 good\n512 1024 bogus\n");
+        fclose(f);
+        extmap_init(&loaded, 0);
+        CHECK(!extmap_load(&loaded, MAP_FILE));
+        extmap_free(&loaded);
+    }
+    f = fopen(MAP_FILE, "w");
+    CHECK(f != NULL);
+    if (f) {
+        fprintf(f, "f3-extmap 2 0\n0 512 good\n");
+        fclose(f);
+        extmap_init(&loaded, 0);
+        CHECK(!extmap_load(&loaded, MAP_FILE));
+        extmap_free(&loaded);
+    }
+    remove(MAP_FILE);
+
+    // A missing file fails rather than loading an empty map
+    extmap_init(&loaded, 0);
+    CHECK(!extmap_load(&loaded, MAP_FILE));
+    extmap_free(&loaded);
+}
+
+int main(void) {
+    test_set();
+    test_coarsen();
+    test_coarsen_gaps();
+    test_save_load();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,118 @@
+#include <string.h>
+
+#include "pattern.h"
+#include "check.h"
+
+#define SECTOR 512
+#define BLOCK (8 * SECTOR)
+
+static const F3Seed seed = {0x0123456789ABCDEFULL, 0xFEDCBA9876543210ULL};
+static const F3Seed other_seed = {0x0123456789ABCDEFULL, 0x0F1E2D3C4B5A6978ULL};
+
+// Data buffers are read as 64-bit words
+static uint64_t expected_words[BLOCK / 8], actual_words[BLOCK / 8];
+static unsigned char *const expected = (unsigned char *)expected_words;
+static unsigned char *const actual = (unsigned char *)actual_words;
+
+static void test_index_inverse(void) {
+    static const uint64_t edges[] = {0, 1, 2, 0x7FFFFFFFFFFFFFFFULL, 0x8000000000000000ULL,
+                                     UINT64_MAX - 1, UINT64_MAX};
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        CHECK(f3_pattern_index(f3_pattern_word(edges[i])) == edges[i]);
+        CHECK(f3_pattern_word(f3_pattern_index(edges[i])) == edges[i]);
+    }
+
+    // Both directions over a spread of values, drawn from the mixer itself
+    int mismatches = 0;
+    uint64_t x = 42;
+    for (int i = 0; i < 100000; i++) {
+        x = f3_pattern_word(x);
+        mismatches += f3_pattern_index(f3_pattern_word(x)) != x;
+        mismatches += f3_pattern_word(f3_pattern_index(x)) != x;
+    }
+    CHECK(mismatches == 0);
+}
+
+static void test_fill(void) {
+    // Any part regenerates the same bytes as the whole
+    f3_fill_pattern(expected, BLOCK, 1 << 20, &seed);
+    f3_fill_pattern(actual, SECTOR, (1 << 20) + 3 * SECTOR, &seed);
+    CHECK(memcmp(actual, expected + 3 * SECTOR, SECTOR) == 0);
+
+    // Another seed gives other bytes
+    f3_fill_pattern(actual, BLOCK, 1 << 20, &other_seed);
+    CHECK(memcmp(actual, expected, BLOCK) != 0);
+}
+
+static void test_classify(void) {
+    memset(actual, 0, SECTOR);
+    CHECK(f3_classify_sector(actual, SECTOR, &seed) == EXT_ZERO);
+    memset(actual, 0xFF, SECTOR);
+    CHECK(f3_classify_sector(actual, SECTOR, &seed) == EXT_ZERO);
+
+    // This run's data for another position is a wraparound, and the
+    // position it came from can be recovered
+    uint64_t source = 3ULL * 1024 * 1024 * 1024 + 7 * SECTOR;
+    f3_fill_pattern(actual, SECTOR, source, &seed);
+    CHECK(f3_classify_sector(actual, SECTOR, &seed) == EXT_OVERWRITTEN);
+    CHECK(f3_pattern_source(actual, SECTOR, &seed) == source);
+
+    // Old data from another run, or a flipped bit, is just changed
+    f3_fill_pattern(actual, SECTOR, source, &other_seed);
+    CHECK(f3_classify_sector(actual, SECTOR, &seed) == EXT_CHANGED);
+    f3_fill_pattern(actual, SECTOR, source, &seed);
+    actual[10] ^= 1;
+    CHECK(f3_classify_sector(actual, SECTOR, &seed) == EXT_CHANGED);
+    memset(actual, 0, SECTOR);
+    actual[SECTOR - 1] = 1;
+    CHECK(f3_classify_sector(actual, SECTOR, &seed) == EXT_CHANGED);
+}
+
+static void test_verify_block(void) {
+    uint64_t pos = 64 * 1024;
+    ExtMap map;
+    extmap_init(&map, 0);
+
+    f3_fill_pattern(expected, BLOCK, pos, &seed);
+    memcpy(actual, expected, BLOCK);
+    CHECK(f3_verify_block(&map, pos, expected, actual, BLOCK, SECTOR, &seed) == 0);
+    CHECK(map.count == 1 && extmap_bytes(&map, EXT_GOOD) == BLOCK);
+
+    // One zeroed and one wrapped sector; the rest stays good
+    memset(actual + SECTOR, 0, SECTOR);
+    f3_fill_pattern(actual + 5 * SECTOR, SECTOR, 0, &seed);
+    CHECK(f3_verify_block(&map, pos, expected, actual, BLOCK, SECTOR, &seed) == 2 * SECTOR);
+    CHECK(extmap_bytes(&map, EXT_ZERO) == SECTOR);
+    CHECK(extmap_bytes(&map, EXT_OVERWRITTEN) == SECTOR);
+    CHECK(extmap_bytes(&map, EXT_GOOD) == BLOCK - 2 * SECTOR);
+    CHECK(extmap_first_bad(&map) == pos + SECTOR);
+
+    extmap_free(&map);
+}
+
+static void test_seed_text(void) {
+    char text[F3_SEED_TEXT_LENGTH + 1];
+    F3Seed parsed;
+
+    f3_seed_format(&seed, text);
+    CHECK(strlen(text) == F3_SEED_TEXT_LENGTH);
+    CHECK(strcmp(text, "fedcba98765432100123456789abcdef") == 0);
+    CHECK(f3_seed_parse(&parsed, text));
+    CHECK(parsed.lo == seed.lo && parsed.hi == seed.hi);
+
+    CHECK(f3_seed_parse(&parsed, "FEDCBA98765432100123456789ABCDEF"));
+    CHECK(parsed.lo == seed.lo && parsed.hi == seed.hi);
+
+    CHECK(!f3_seed_parse(&parsed, "fedcba98765432100123456789abcdeg"));
+    CHECK(!f3_seed_parse(&parsed, "fedcba9876543210"));
+    CHECK(!f3_seed_parse(&parsed, ""));
+}
+
+int main(void) {
+    test_index_inverse();
+    test_fill();
+    test_classify();
+    test_verify_block();
+    test_seed_text();
+    return CHECK_RESULT();
+}
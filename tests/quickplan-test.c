@@ -0,0 +1,94 @@
+#include "quickplan.h"
+#include "check.h"
+
+#define MB (1024ULL * 1024)
+#define GB (1024 * MB)
+
+static uint64_t points[QUICK_MAX_POINTS];
+
+// Every point in range, aligned and listed once
+static int valid_plan(int count, uint64_t drive_size, uint64_t block_size, uint64_t sector) {
+    if (count < 0 || count > QUICK_MAX_POINTS) {
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        if (points[i] < block_size || points[i] + block_size > drive_size ||
+            points[i] % sector != 0) {
+            return 0;
+        }
+        for (int j = 0; j < i; j++) {
+            if (points[j] == points[i]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int index_of(int count, uint64_t pos) {
+    for (int i = 0; i < count; i++) {
+        if (points[i] == pos) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void test_too_small(void) {
+    CHECK(quickplan_points(points, 0, MB, 512) == 0);
+    CHECK(quickplan_points(points, 2 * MB - 1, MB, 512) == 0);
+    CHECK(quickplan_points(points, 16 * GB, 0, 512) == 0);
+    CHECK(quickplan_points(points, 16 * GB, MB, 0) == 0);
+
+    // Room for exactly one block past the first
+    int count = quickplan_points(points, 2 * MB, MB, 512);
+    CHECK(count == 1 && points[0] == MB);
+}
+
+static void test_order(void) {
+    uint64_t drive_size = 16 * GB;
+    int count = quickplan_points(points, drive_size, MB, 512);
+    CHECK(count > 0);
+    CHECK(valid_plan(count, drive_size, MB, 512));
+
+    // The last block comes first, then both sides of the largest
+    // power-of-two capacity below the device
+    CHECK(points[0] == drive_size - MB);
+    CHECK(points[1] == 8 * GB && points[2] == 8 * GB - MB);
+
+    // Smaller capacities follow in descending order
+    int at_4g = index_of(count, 4 * GB);
+    int at_2g = index_of(count, 2 * GB);
+    CHECK(at_4g > 2 && at_2g > at_4g);
+    CHECK(index_of(count, 64 * MB) > 0);
+}
+
+static void test_unaligned(void) {
+    // A size no power of two divides, with 4K sectors
+    uint64_t drive_size = 7 * GB + 12345;
+    int count = quickplan_points(points, drive_size, MB, 4096);
+    CHECK(count > 0);
+    CHECK(valid_plan(count, drive_size, MB, 4096));
+    CHECK(points[0] % 4096 == 0 && drive_size - points[0] < MB + 4096);
+
+    // Blocks that are not a multiple of the sector still give aligned points
+    count = quickplan_points(points, drive_size, MB + 512, 4096);
+    CHECK(count > 0);
+    CHECK(valid_plan(count, drive_size, MB + 512, 4096));
+}
+
+static void test_limit(void) {
+    // Fine subdivisions of a huge device must not overflow the array
+    uint64_t drive_size = 64 * 1024 * GB;
+    int count = quickplan_points(points, drive_size, 4096, 512);
+    CHECK(count > 0 && count <= QUICK_MAX_POINTS);
+    CHECK(valid_plan(count, drive_size, 4096, 512));
+}
+
+int main(void) {
+    test_too_small();
+    test_order();
+    test_unaligned();
+    test_limit();
+    return CHECK_RESULT();
+}
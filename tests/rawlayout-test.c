@@ -0,0 +1,116 @@
+#include <string.h>
+
+#include "rawlayout.h"
+#include "check.h"
+
+static unsigned char buf[RAWLAYOUT_HEADER_SIZE];
+
+static void sample(RawLayout *layout) {
+    memset(layout, 0, sizeof(*layout));
+    layout->version = RAWLAYOUT_VERSION;
+    layout->complete = 1;
+    layout->data_offset = RAWLAYOUT_DATA_OFFSET;
+    layout->data_size = 15ULL * 1024 * 1024 * 1024;
+    layout->written = layout->data_size - 4096;
+    layout->block_size = 8 * 1024 * 1024;
+    layout->seed_lo = 0x0123456789ABCDEFULL;
+    layout->seed_hi = 0xFEDCBA9876543210ULL;
+    layout->created = -1;  // All bits set survives the unsigned field
+}
+
+static void test_round_trip(void) {
+    RawLayout layout, decoded;
+    sample(&layout);
+    rawlayout_encode(&layout, buf);
+
+    memset(&decoded, 0xAA, sizeof(decoded));
+    CHECK(rawlayout_decode(&decoded, buf));
+    CHECK(decoded.version == layout.version);
+    CHECK(decoded.complete == layout.complete);
+    CHECK(decoded.data_offset == layout.data_offset);
+    CHECK(decoded.data_size == layout.data_size);
+    CHECK(decoded.written == layout.written);
+    CHECK(decoded.block_size == layout.block_size);
+    CHECK(decoded.seed_lo == layout.seed_lo);
+    CHECK(decoded.seed_hi == layout.seed_hi);
+    CHECK(decoded.created == layout.created);
+
+    // Little-endian at fixed offsets, whatever the host
+    CHECK(memcmp(buf, "F3RAWLY1", 8) == 0);
+    CHECK(buf[8] == RAWLAYOUT_VERSION && buf[12] == 1);
+    CHECK(buf[48] == 0xEF && buf[55] == 0x01);
+
+    // The rest of the header is zeroed
+    int nonzero = 0;
+    for (int i = 80; i < RAWLAYOUT_HEADER_SIZE; i++) {
+        nonzero += buf[i] != 0;
+    }
+    CHECK(nonzero == 0);
+}
+
+static void test_checksum(void) {
+    RawLayout layout, decoded;
+    sample(&layout);
+
+    // A flipped bit anywhere in the fields or the checksum is caught
+    int accepted = 0;
+    for (int i = 0; i < 80; i++) {
+        rawlayout_encode(&layout, buf);
+        buf[i] ^= 0x10;
+        accepted += rawlayout_decode(&decoded, buf);
+    }
+    CHECK(accepted == 0);
+
+    // A blank or foreign sector is not a header
+    memset(buf, 0, sizeof(buf));
+    CHECK(!rawlayout_decode(&decoded, buf));
+    memset(buf, 0xFF, sizeof(buf));
+    CHECK(!rawlayout_decode(&decoded, buf));
+}
+
+static void test_invalid_fields(void) {
+    RawLayout layout, decoded;
+
+    // Valid checksums over fields no writer produces
+    sample(&layout);
+    layout.version = 1;
+    rawlayout_encode(&layout, buf);
+    CHECK(!rawlayout_decode(&decoded, buf));
+
+    sample(&layout);
+    layout.written = layout.data_size + 1;
+    rawlayout_encode(&layout, buf);
+    CHECK(!rawlayout_decode(&decoded, buf));
+
+    sample(&layout);
+    layout.data_offset = RAWLAYOUT_HEADER_SIZE - 512;
+    rawlayout_encode(&layout, buf);
+    CHECK(!rawlayout_decode(&decoded, buf));
+}
+
+static void test_fits(void) {
+    RawLayout layout;
+    sample(&layout);
+    uint64_t end = layout.data_offset + layout.data_size;
+
+    CHECK(rawlayout_fits(&layout, end));
+    CHECK(rawlayout_fits(&layout, end + 1));
+    CHECK(!rawlayout_fits(&layout, end - 1));
+    CHECK(!rawlayout_fits(&layout, 0));
+
+    // Sizes that would wrap around when added up
+    layout.data_size = UINT64_MAX;
+    CHECK(!rawlayout_fits(&layout, UINT64_MAX));
+    layout.data_size = 0;
+    layout.data_offset = UINT64_MAX;
+    CHECK(rawlayout_fits(&layout, UINT64_MAX));
+    CHECK(!rawlayout_fits(&layout, UINT64_MAX - 1));
+}
+
+int main(void) {
+    test_round_trip();
+    test_checksum();
+    test_invalid_fields();
+    test_fits();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "result.h"
+#include "check.h"
+
+#define MB (1024ULL * 1024)
+#define SECTOR 512
+#define CHUNK (256 * 1024)
+
+static const F3Seed seed = {0x1122334455667788ULL, 0x99AABBCCDDEEFF00ULL};
+
+// A simulated drive of claimed bytes holding only real bytes. A wrapping
+// drive aliases offsets modulo real; otherwise what lies past real reads
+// back as zeros.
+typedef struct {
+    unsigned char *data;
+    uint64_t real;
+    uint64_t claimed;
+    int wraps;
+} FakeDrive;
+
+static uint64_t chunk_words[CHUNK / 8], expected_words[CHUNK / 8], actual_words[CHUNK / 8];
+static unsigned char *const chunk = (unsigned char *)chunk_words;
+static unsigned char *const expected = (unsigned char *)expected_words;
+static unsigned char *const actual = (unsigned char *)actual_words;
+
+static void drive_write(FakeDrive *d, uint64_t pos, const unsigned char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (d->wraps) {
+            d->data[(pos + i) % d->real] = buf[i];
+        } else if (pos + i < d->real) {
+            d->data[pos + i] = buf[i];
+        }
+    }
+}
+
+static void drive_read(const FakeDrive *d, uint64_t pos, unsigned char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (d->wraps) {
+            buf[i] = d->data[(pos + i) % d->real];
+        } else {
+            buf[i] = pos + i < d->real ? d->data[pos + i] : 0;
+        }
+    }
+}
+
+// Write the whole surface, then read it all back and judge it, the way
+// the full-surface probe does
+static FakeType full_surface(FakeDrive *d, F3Result *result) {
+    f3_result_init(result);
+    for (uint64_t pos = 0; pos < d->claimed; pos += CHUNK) {
+        f3_fill_pattern(chunk, CHUNK, pos, &seed);
+        drive_write(d, pos, chunk, CHUNK);
+    }
+    for (uint64_t pos = 0; pos < d->claimed; pos += CHUNK) {
+        f3_fill_pattern(expected, CHUNK, pos, &seed);
+        drive_read(d, pos, actual, CHUNK);
+        f3_result_verify(result, pos, expected, actual, CHUNK, SECTOR, &seed);
+    }
+    result->tested = d->claimed;
+    return f3_judge_surface(result);
+}
+
+static void test_genuine(void) {
+    FakeDrive d = {NULL, 8 * MB, 8 * MB, 0};
+    d.data = (unsigned char *)calloc(1, d.real);
+    F3Result result;
+
+    CHECK(full_surface(&d, &result) == FAKE_TYPE_GOOD);
+    CHECK(result.wrap == 0);
+    CHECK(result.usable_size == 8 * MB);
+
+    f3_result_free(&result);
+    free(d.data);
+}
+
+static void test_wraparound(void) {
+    // Claims four times what it holds; only the last copy of each block
+    // survives, so the first three quarters read back data from later on
+    FakeDrive d = {NULL, 4 * MB, 16 * MB, 1};
+    d.data = (unsigned char *)calloc(1, d.real);
+    F3Result result;
+
+    CHECK(full_surface(&d, &result) == FAKE_TYPE_POSSIBLY_FAKE);
+    CHECK(result.wrap == 4 * MB);
+    CHECK(result.capacity_low == 4 * MB && result.capacity_high == 4 * MB);
+    CHECK(result.usable_size == 4 * MB);
+    CHECK(result.note != NULL);
+    CHECK(extmap_first_bad(&result.map) == 0);
+    CHECK(extmap_bytes(&result.map, EXT_OVERWRITTEN) == 12 * MB);
+    CHECK(extmap_bytes(&result.map, EXT_GOOD) == 4 * MB);
+
+    f3_result_free(&result);
+    free(d.data);
+}
+
+static void test_wraparound_large(void) {
+    // Far past the 0.9 bad fraction, and still not a zero capacity
+    FakeDrive d = {NULL, 1 * MB, 32 * MB, 1};
+    d.data = (unsigned char *)calloc(1, d.real);
+    F3Result result;
+
+    CHECK(full_surface(&d, &result) == FAKE_TYPE_POSSIBLY_FAKE);
+    CHECK(result.capacity_low == 1 * MB && result.capacity_high == 1 * MB);
+
+    f3_result_free(&result);
+    free(d.data);
+}
+
+static void test_blank_tail(void) {
+    // Storage ends at 6 MB and nothing past it sticks
+    FakeDrive d = {NULL, 6 * MB, 16 * MB, 0};
+    d.data = (unsigned char *)calloc(1, d.real);
+    F3Result result;
+
+    CHECK(full_surface(&d, &result) == FAKE_TYPE_POSSIBLY_FAKE);
+    CHECK(result.wrap == 0);
+    CHECK(result.capacity_low == 6 * MB && result.capacity_high == 6 * MB);
+    CHECK(result.usable_size == 6 * MB);
+
+    f3_result_free(&result);
+    free(d.data);
+}
+
+static void test_damaged(void) {
+    F3Result result;
+
+    // Scattered bad sectors are damage, not a fake
+    f3_result_init(&result);
+    result.tested = 16 * MB;
+    extmap_set(&result.map, 0, 16 * MB, EXT_GOOD);
+    extmap_set(&result.map, 3 * MB, 3 * MB + SECTOR, EXT_CHANGED);
+    extmap_set(&result.map, 9 * MB, 9 * MB + SECTOR, EXT_UNREADABLE);
+    CHECK(f3_judge_surface(&result) == FAKE_TYPE_DAMAGED);
+    CHECK(result.usable_size == 3 * MB);
+    f3_result_free(&result);
+
+    // Nothing reads back at all: no capacity to report
+    f3_result_init(&result);
+    result.tested = 16 * MB;
+    extmap_set(&result.map, 0, 16 * MB, EXT_ZERO);
+    CHECK(f3_judge_surface(&result) == FAKE_TYPE_DAMAGED);
+    f3_result_free(&result);
+}
+
+int main(void) {
+    test_genuine();
+    test_wraparound();
+    test_wraparound_large();
+    test_blank_tail();
+    test_damaged();
+    return CHECK_RESULT();
+}
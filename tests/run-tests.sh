@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Build and run the unit tests of the portable modules with the host
+# compiler. They need no Windows headers, so any C99 compiler will do.
+
+set -e
+
+SCRIPTDIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+SRCDIR="$(dirname "$SCRIPTDIR")"
+CC="${CC:-cc} -std=c99 -Wall -Wextra -Werror -I$SRCDIR"
+
+BUILDDIR="$(mktemp -d)"
+trap 'rm -rf "$BUILDDIR"' EXIT
+cd "$BUILDDIR"
+
+FAILED=0
+
+# run_test NAME SOURCES...: link tests/NAME.c with the modules it covers
+run_test() {
+  local name="$1"
+  shift
+  local sources=""
+  for src in "$@"; do
+    sources="$sources $SRCDIR/$src"
+  done
+  $CC "$SCRIPTDIR/$name.c" $sources -o "$name"
+  if ./"$name"; then
+    echo "PASS: $name"
+  else
+    echo "FAIL: $name"
+    FAILED=1
+  fi
+}
+
+run_test extmap-test extmap.c
+run_test pattern-test pattern.c extmap.c
+run_test result-test result.c pattern.c extmap.c
+run_test quickplan-test quickplan.c
+run_test rawlayout-test rawlayout.c
+
+exit $FAILED